@@ -0,0 +1,384 @@
+// This file contains a headless benchmark for the EQ's processBlock.
+// It builds the processor directly, without a host or editor, and times
+// it on white noise for every combination of block size, channel count
+// and filter mode. Results are written as JSON so runs from different
+// releases and machines can be compared by script.
+//
+// Build it as a console application with the plug-in's sources and
+// JuceLibraryCode, then run:
+//
+//     Benchmark [--quick] [--verify] [--kernels] [--soak] [--seconds <audio seconds per case>] [--output <file.json>]
+//
+// Without --output the JSON goes to stdout, progress always goes to stderr.
+// --verify checks every processing path against reference renders instead
+// of timing them (see Verification.cpp), and exits with 1 if any check fails.
+// --kernels times each FIR kernel this CPU can run against the scalar one.
+// --soak runs processBlock on a simulated audio clock for --seconds of wall
+// time (a minute by default) with automation and editor reads alongside, and
+// exits with 1 if any callback misses its deadline (see Soak.cpp). It takes
+//
+//     --mode <name>            one of the modes below, fir-129 by default
+//     --block <samples>        callback size, default 256
+//     --channels <n>           default 2
+//     --load <threads>         background threads competing for CPU and memory
+
+#include "../PluginProcessor.h"
+#include "Verification.h"
+#include "Soak.h"
+#include <iostream>
+
+namespace
+{
+    // One filter setup to measure
+    struct ModeSetup
+    {
+        const char* name;
+        int mode;           // index of the mode parameter
+        int lengthIndex;    // index of the kernel length parameter
+    };
+
+    const ModeSetup allModes[] =
+    {
+        { "fir-65",    0, 2 },
+        { "fir-129",   0, 3 },
+        { "fft-513",   0, 5 },
+        { "fft-4097",  0, 8 },
+        { "iir",       1, 3 }
+    };
+
+    const int allBlockSizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+    const int allChannelCounts[] = { 1, 2, 6, 12, 16 };
+
+    const int quickBlockSizes[] = { 64, 512, 4096 };
+    const int quickChannelCounts[] = { 2, 16 };
+
+    const double sampleRate = 48000.0;
+
+    // Kernel lengths for --kernels, all at one block size. 41 taps was the length of
+    // the original hard coded kernels, and 33 is the shortest of the length parameter.
+    const int kernelTapCounts[] = { 33, 41, 65, 129, 257 };
+    const int kernelBlockSize = 512;
+
+    // Times one case and returns its results as a JSON object
+    var runCase (const ModeSetup& setup, int numChannels, int blockSize, double seconds)
+    {
+        ParametricEqAudioProcessor processor;
+        *processor.getChoiceParameter ("mode") = setup.mode;
+        *processor.getChoiceParameter ("kernellength") = setup.lengthIndex;
+
+        // the kernels for the chosen length are designed in prepareToPlay
+        processor.setPlayConfigDetails (numChannels, numChannels, sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        Random random (0x5eed);
+        AudioBuffer<float> noise (numChannels, blockSize);
+        for (int chan = 0; chan < numChannels; chan++)
+            for (int i = 0; i < blockSize; i++)
+                noise.setSample (chan, i, random.nextFloat() * 2.0f - 1.0f);
+
+        AudioBuffer<float> buffer (numChannels, blockSize);
+        MidiBuffer midi;
+
+        // enough blocks for stable percentiles even at the largest block size
+        const int numBlocks = jmax (64, roundToInt (seconds * sampleRate / blockSize));
+        const int numWarmUpBlocks = jmax (8, numBlocks / 10);
+
+        std::vector<double> blockSeconds;
+        blockSeconds.reserve ((size_t) numBlocks);
+
+        for (int block = 0; block < numWarmUpBlocks + numBlocks; block++)
+        {
+            for (int chan = 0; chan < numChannels; chan++)
+                buffer.copyFrom (chan, 0, noise, chan, 0, blockSize);
+
+            const int64 start = Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midi);
+            const int64 end = Time::getHighResolutionTicks();
+
+            if (block >= numWarmUpBlocks)
+                blockSeconds.push_back (Time::highResolutionTicksToSeconds (end - start));
+        }
+
+        processor.releaseResources();
+
+        double totalSeconds = 0;
+        for (double t : blockSeconds)
+            totalSeconds += t;
+
+        std::sort (blockSeconds.begin(), blockSeconds.end());
+        auto percentile = [&blockSeconds] (double p)
+        {
+            const size_t index = jmin (blockSeconds.size() - 1, (size_t) (p * (double) blockSeconds.size()));
+            return blockSeconds[index] * 1.0e6;
+        };
+
+        const double numFrames = (double) numBlocks * blockSize;
+        const double audioSeconds = numFrames / sampleRate;
+
+        DynamicObject* blockTimes = new DynamicObject();
+        blockTimes->setProperty ("p50", percentile (0.5));
+        blockTimes->setProperty ("p99", percentile (0.99));
+        blockTimes->setProperty ("max", blockSeconds.back() * 1.0e6);
+
+        DynamicObject* result = new DynamicObject();
+        result->setProperty ("mode", setup.name);
+        result->setProperty ("channels", numChannels);
+        result->setProperty ("blockSize", blockSize);
+        result->setProperty ("latencySamples", processor.getLatencySamples());
+        result->setProperty ("blocks", numBlocks);
+        result->setProperty ("nsPerSample", totalSeconds * 1.0e9 / numFrames);
+        result->setProperty ("nsPerChannelSample", totalSeconds * 1.0e9 / (numFrames * numChannels));
+        result->setProperty ("realtimeFactor", audioSeconds / totalSeconds);
+        result->setProperty ("blockMicroseconds", var (blockTimes));
+        return var (result);
+    }
+
+    // Times one FIR kernel on a block of noise with its history in front. Returns the
+    // median block in ns per output sample, so the odd preempted block doesn't count.
+    template <typename FloatType>
+    double timeKernel (FIRKernels::ProcessFunction<FloatType> process, const FloatType* coeffs, int numTaps, double seconds)
+    {
+        Random random (0x5eed);
+        HeapBlock<FloatType> input ((size_t) (numTaps - 1 + kernelBlockSize));
+        for (int i = 0; i < numTaps - 1 + kernelBlockSize; i++)
+            input[i] = (FloatType) (random.nextFloat() * 2.0f - 1.0f);
+
+        HeapBlock<FloatType> output ((size_t) kernelBlockSize);
+
+        const int numBlocks = jmax (64, roundToInt (seconds * sampleRate / kernelBlockSize));
+        const int numWarmUpBlocks = jmax (8, numBlocks / 10);
+        std::vector<double> blockTimes;
+        blockTimes.reserve ((size_t) numBlocks);
+
+        for (int block = 0; block < numWarmUpBlocks + numBlocks; block++)
+        {
+            const int64 start = Time::getHighResolutionTicks();
+            process (input + numTaps - 1, output, kernelBlockSize, coeffs, numTaps);
+            const int64 end = Time::getHighResolutionTicks();
+
+            if (block >= numWarmUpBlocks)
+                blockTimes.push_back (Time::highResolutionTicksToSeconds (end - start));
+        }
+
+        std::sort (blockTimes.begin(), blockTimes.end());
+        return blockTimes[blockTimes.size() / 2] * 1.0e9 / kernelBlockSize;
+    }
+
+    // Times every FIR kernel this CPU supports on a designed kernel of numTaps taps,
+    // against processScalar, which is the plain loop the plug-in used to run
+    template <typename FloatType>
+    var runKernelCase (int numTaps, double seconds)
+    {
+        KernelSettings settings;
+        settings.sampleRate = sampleRate;
+        settings.length = numTaps;
+        std::unique_ptr<EQKernelSet> bands (KernelDesigner::design (settings));
+
+        // an uneven mix of the bands, still symmetric like every combined kernel
+        HeapBlock<FloatType> coeffs ((size_t) numTaps, true);
+        const float gains[3] = { 1.3f, 0.6f, 1.1f };
+        for (int band = 0; band < 3; band++)
+            for (int k = 0; k < numTaps; k++)
+                coeffs[k] += (FloatType) (gains[band] * bands->bands.getSample (band, k));
+
+        StringArray names;
+        Array<FIRKernels::ProcessFunction<FloatType>> functions;
+
+        names.add ("scalar");
+        functions.add (FIRKernels::processScalar<FloatType>);
+
+       #if JUCE_INTEL
+        if (SystemStats::hasSSE2())
+        {
+            names.add ("sse");
+            functions.add (FIRKernels::processSSE);
+        }
+
+        if (SystemStats::hasAVX2() && SystemStats::hasFMA3())
+        {
+            names.add ("avx2");
+            functions.add (FIRKernels::processAVX2);
+        }
+       #endif
+
+        names.add ("symmetric");
+        functions.add (FIRKernels::getSymmetricProcessFunction<FloatType> (numTaps));
+
+        DynamicObject* nsPerSample = new DynamicObject();
+        DynamicObject* speedup = new DynamicObject();
+        double scalarNs = 0;
+
+        for (int i = 0; i < names.size(); i++)
+        {
+            const double ns = timeKernel<FloatType> (functions[i], coeffs, numTaps, seconds);
+            if (i == 0)
+                scalarNs = ns;
+
+            nsPerSample->setProperty (names[i], ns);
+            speedup->setProperty (names[i], scalarNs / ns);
+        }
+
+        DynamicObject* result = new DynamicObject();
+        result->setProperty ("mode", "kernels");
+        result->setProperty ("precision", sizeof (FloatType) == sizeof (float) ? "float" : "double");
+        result->setProperty ("taps", numTaps);
+        result->setProperty ("blockSize", kernelBlockSize);
+        result->setProperty ("nsPerSample", var (nsPerSample));
+        result->setProperty ("speedup", var (speedup));
+        return var (result);
+    }
+
+    const ModeSetup* findMode (const String& name)
+    {
+        for (const ModeSetup& setup : allModes)
+            if (name == setup.name)
+                return &setup;
+
+        return nullptr;
+    }
+
+    // Value following an option, or the default if it isn't given
+    String getOption (const StringArray& args, const String& option, const String& defaultValue)
+    {
+        const int index = args.indexOf (option);
+        return index >= 0 && index + 1 < args.size() ? args[index + 1] : defaultValue;
+    }
+
+    var getMachineInfo()
+    {
+        DynamicObject* machine = new DynamicObject();
+        machine->setProperty ("os", SystemStats::getOperatingSystemName());
+        machine->setProperty ("cpuVendor", SystemStats::getCpuVendor());
+        machine->setProperty ("cpuMHz", SystemStats::getCpuSpeedInMegahertz());
+        machine->setProperty ("logicalCpus", SystemStats::getNumCpus());
+        machine->setProperty ("physicalCpus", SystemStats::getNumPhysicalCpus());
+        machine->setProperty ("sse2", SystemStats::hasSSE2());
+        machine->setProperty ("avx2", SystemStats::hasAVX2());
+        machine->setProperty ("fma3", SystemStats::hasFMA3());
+        return var (machine);
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    StringArray args;
+    for (int i = 1; i < argc; i++)
+        args.add (argv[i]);
+
+    const bool quick = args.contains ("--quick");
+    const bool verify = args.contains ("--verify");
+    const bool kernels = args.contains ("--kernels");
+    const bool soak = args.contains ("--soak");
+
+    double seconds = 2.0;
+    const int secondsIndex = args.indexOf ("--seconds");
+    if (secondsIndex >= 0 && secondsIndex + 1 < args.size())
+        seconds = jmax (0.01, args[secondsIndex + 1].getDoubleValue());
+
+    String outputPath;
+    const int outputIndex = args.indexOf ("--output");
+    if (outputIndex >= 0 && outputIndex + 1 < args.size())
+        outputPath = args[outputIndex + 1];
+
+    Array<int> blockSizes, channelCounts;
+    if (quick)
+    {
+        for (int size : quickBlockSizes)       blockSizes.add (size);
+        for (int count : quickChannelCounts)   channelCounts.add (count);
+    }
+    else
+    {
+        for (int size : allBlockSizes)         blockSizes.add (size);
+        for (int count : allChannelCounts)     channelCounts.add (count);
+    }
+
+    var results = var::emptyArray();
+    bool allPassed = true;
+
+    if (verify)
+    {
+        results = Verification::runAll (quick, allPassed);
+    }
+    else if (soak)
+    {
+        Soak::Options options;
+        options.sampleRate = sampleRate;
+        options.seconds = secondsIndex >= 0 ? seconds : (quick ? 10.0 : 60.0);
+
+        const String modeName = getOption (args, "--mode", "fir-129");
+        const ModeSetup* setup = findMode (modeName);
+        if (setup == nullptr)
+        {
+            std::cerr << "Unknown mode " << modeName << std::endl;
+            return 1;
+        }
+
+        options.mode = setup->mode;
+        options.lengthIndex = setup->lengthIndex;
+        options.blockSize = jmax (1, getOption (args, "--block", "256").getIntValue());
+        options.numChannels = jmax (1, getOption (args, "--channels", "2").getIntValue());
+        options.numLoadThreads = jmax (0, getOption (args, "--load", "0").getIntValue());
+
+        std::cerr << "soak, " << setup->name << ", " << options.numChannels << " channels, " << options.blockSize
+                  << " samples, " << options.numLoadThreads << " load threads, " << options.seconds << " s" << std::endl;
+
+        results.append (Soak::run (options, allPassed));
+    }
+    else if (kernels)
+    {
+        for (int numTaps : kernelTapCounts)
+        {
+            std::cerr << "kernels, " << numTaps << " taps" << std::endl;
+            results.append (runKernelCase<float> (numTaps, seconds));
+            results.append (runKernelCase<double> (numTaps, seconds));
+        }
+    }
+    else
+    {
+        for (const ModeSetup& setup : allModes)
+        {
+            for (int numChannels : channelCounts)
+            {
+                for (int blockSize : blockSizes)
+                {
+                    std::cerr << setup.name << ", " << numChannels << " channels, "
+                              << blockSize << " samples" << std::endl;
+
+                    results.append (runCase (setup, numChannels, blockSize, seconds));
+                }
+            }
+        }
+    }
+
+    DynamicObject* report = new DynamicObject();
+    report->setProperty ("plugin", JucePlugin_Name);
+    report->setProperty ("version", JucePlugin_VersionString);
+    report->setProperty ("juce", SystemStats::getJUCEVersion());
+    report->setProperty ("time", Time::getCurrentTime().toISO8601 (true));
+    report->setProperty ("machine", getMachineInfo());
+    report->setProperty ("sampleRate", sampleRate);
+    report->setProperty ("secondsPerCase", seconds);
+    report->setProperty ("results", results);
+    if (verify || soak)
+        report->setProperty ("passed", allPassed);
+
+    const String json = JSON::toString (var (report));
+
+    if (outputPath.isEmpty())
+    {
+        std::cout << json << std::endl;
+        return allPassed ? 0 : 1;
+    }
+
+    File outputFile = File::getCurrentWorkingDirectory().getChildFile (outputPath);
+    if (! outputFile.replaceWithText (json))
+    {
+        std::cerr << "Couldn't write " << outputPath << std::endl;
+        return 1;
+    }
+
+    return allPassed ? 0 : 1;
+}
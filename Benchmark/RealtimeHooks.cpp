@@ -0,0 +1,147 @@
+// This file contains the allocation and lock hooks used by Benchmark --verify.
+// Each hook bumps a thread local counter if its thread is being watched, then
+// calls glibc's own entry point, so the rest of the program is unaffected.
+// The counters are plain thread locals, which need no allocation on first use.
+
+#include "RealtimeHooks.h"
+
+#if JUCE_LINUX && ! defined (__SANITIZE_ADDRESS__) && ! defined (__SANITIZE_THREAD__)
+ #define EQ_REALTIME_HOOKS 1
+#else
+ #define EQ_REALTIME_HOOKS 0
+#endif
+
+#if EQ_REALTIME_HOOKS
+#include <pthread.h>
+#include <dlfcn.h>
+#include <cerrno>
+
+namespace
+{
+    thread_local bool watching = false;
+    thread_local int numAllocations = 0;
+    thread_local int numFrees = 0;
+    thread_local int numLocks = 0;
+
+    inline void countAllocation()   { if (watching) numAllocations++; }
+    inline void countFree()         { if (watching) numFrees++; }
+    inline void countLock()         { if (watching) numLocks++; }
+
+    // glibc's internal mutex entry points can't be linked against, so the real
+    // functions are looked up past this executable before any thread starts
+    typedef int (*MutexFunction) (pthread_mutex_t*);
+    MutexFunction glibcMutexLock = nullptr;
+    MutexFunction glibcMutexTryLock = nullptr;
+
+    void findMutexFunctions()
+    {
+        glibcMutexLock = (MutexFunction) dlsym (RTLD_NEXT, "pthread_mutex_lock");
+        glibcMutexTryLock = (MutexFunction) dlsym (RTLD_NEXT, "pthread_mutex_trylock");
+    }
+
+    __attribute__ ((constructor (101))) void findMutexFunctionsAtStartup()
+    {
+        findMutexFunctions();
+    }
+}
+
+extern "C"
+{
+    // glibc's own implementations, which the hooks forward to
+    void* __libc_malloc (size_t size);
+    void* __libc_calloc (size_t count, size_t size);
+    void* __libc_realloc (void* block, size_t size);
+    void* __libc_memalign (size_t alignment, size_t size);
+    void  __libc_free (void* block);
+
+    void* malloc (size_t size)
+    {
+        countAllocation();
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size)
+    {
+        countAllocation();
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* block, size_t size)
+    {
+        countAllocation();
+        return __libc_realloc (block, size);
+    }
+
+    void* memalign (size_t alignment, size_t size)
+    {
+        countAllocation();
+        return __libc_memalign (alignment, size);
+    }
+
+    void* aligned_alloc (size_t alignment, size_t size)
+    {
+        countAllocation();
+        return __libc_memalign (alignment, size);
+    }
+
+    int posix_memalign (void** result, size_t alignment, size_t size)
+    {
+        countAllocation();
+        *result = __libc_memalign (alignment, size);
+        return *result != nullptr || size == 0 ? 0 : ENOMEM;
+    }
+
+    void free (void* block)
+    {
+        countFree();
+        __libc_free (block);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        countLock();
+        if (glibcMutexLock == nullptr)
+            findMutexFunctions();
+
+        return glibcMutexLock (mutex);
+    }
+
+    int pthread_mutex_trylock (pthread_mutex_t* mutex)
+    {
+        countLock();
+        if (glibcMutexTryLock == nullptr)
+            findMutexFunctions();
+
+        return glibcMutexTryLock (mutex);
+    }
+}
+#endif
+
+//==============================================================================
+bool RealtimeHooks::isAvailable()
+{
+    return EQ_REALTIME_HOOKS != 0;
+}
+
+void RealtimeHooks::setWatching (bool shouldWatch)
+{
+   #if EQ_REALTIME_HOOKS
+    watching = shouldWatch;
+   #else
+    ignoreUnused (shouldWatch);
+   #endif
+}
+
+RealtimeHooks::Counts RealtimeHooks::takeCounts()
+{
+    Counts counts;
+
+   #if EQ_REALTIME_HOOKS
+    counts.allocations = numAllocations;
+    counts.frees = numFrees;
+    counts.locks = numLocks;
+    numAllocations = numFrees = numLocks = 0;
+   #endif
+
+    return counts;
+}
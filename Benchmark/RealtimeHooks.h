@@ -0,0 +1,32 @@
+// This is the header for the allocation and lock hooks used by Benchmark --verify.
+// On Linux the benchmark replaces malloc and its relatives and the pthread mutex
+// lock calls with versions that count every call made by a thread that is being
+// watched, and then pass it on to glibc. --verify watches the thread it calls
+// processBlock on, so anything the audio thread would allocate, free or lock shows
+// up, whether it comes from new, HeapBlock, std::mutex or a CriticalSection.
+// Elsewhere, and in sanitizer builds that hook the allocator themselves, the hooks
+// are compiled out and isAvailable() is false.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace RealtimeHooks
+{
+    // Calls counted on the watched thread since the last takeCounts()
+    struct Counts
+    {
+        int allocations = 0;    // malloc, calloc, realloc and the aligned versions
+        int frees = 0;
+        int locks = 0;          // pthread_mutex_lock and trylock
+    };
+
+    // True where the hooks are compiled in
+    bool isAvailable();
+
+    // Starts or stops counting the calling thread's calls
+    void setWatching (bool shouldWatch);
+
+    // Returns the calling thread's counts and resets them
+    Counts takeCounts();
+}
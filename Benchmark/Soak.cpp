@@ -0,0 +1,394 @@
+// This file contains the soak test. An audio clock thread wakes once per
+// block period, like a device callback, and runs processBlock on noise. A
+// callback has until the next one is due to finish, as with a double
+// buffered device, and one that doesn't is counted as an xrun. Alongside it
+// a host automation thread moves the gains and crossovers, an editor thread
+// makes the reads the open editor would, and optional load threads stream
+// through a large buffer to compete for the CPU and memory bandwidth.
+
+#include "Soak.h"
+#include "../KernelCache.h"
+#include <iostream>
+
+namespace
+{
+    // Xruns whose time into the run is listed in the report, the rest are only counted
+    const int maxListedXruns = 100;
+
+    // Each load thread streams through this much memory, far more than any cache
+    const int loadBufferSamples = 16 * 1024 * 1024;
+
+    // Seconds between progress lines
+    const double progressInterval = 10.0;
+
+    // Log spaced histogram of microseconds, eight buckets per octave from 1us to over a minute.
+    // Fixed size, so hours of blocks cost no more memory than seconds of them.
+    class Histogram
+    {
+    public:
+        static const int bucketsPerOctave = 8;
+        static const int numBuckets = 216;
+
+        void add (double microseconds)
+        {
+            const int bucket = microseconds > 1.0 ? jmin (numBuckets - 1, (int) (bucketsPerOctave * std::log2 (microseconds)))
+                                                  : 0;
+            counts[bucket]++;
+            total++;
+            maximum = jmax (maximum, microseconds);
+        }
+
+        // Value the given fraction of samples stayed under, to the resolution of the buckets
+        double getPercentile (double fraction) const
+        {
+            if (total == 0)
+                return 0.0;
+
+            const int64 target = jmax ((int64) 1, (int64) std::ceil (fraction * (double) total));
+            int64 count = 0;
+
+            for (int bucket = 0; bucket < numBuckets - 1; bucket++)
+            {
+                count += counts[bucket];
+                if (count >= target)
+                    return jmin (maximum, std::pow (2.0, (bucket + 1) / (double) bucketsPerOctave));
+            }
+
+            return maximum;
+        }
+
+        var toJSON() const
+        {
+            DynamicObject* result = new DynamicObject();
+            result->setProperty ("p50", getPercentile (0.5));
+            result->setProperty ("p99", getPercentile (0.99));
+            result->setProperty ("p99.9", getPercentile (0.999));
+            result->setProperty ("p99.99", getPercentile (0.9999));
+            result->setProperty ("max", maximum);
+            return var (result);
+        }
+
+    private:
+        int64 counts[numBuckets] = {};
+        int64 total = 0;
+        double maximum = 0.0;
+    };
+
+    //==============================================================================
+    // Calls processBlock once per block period. The histograms are only written here and
+    // only read once the thread has stopped, the counters can be read at any time.
+    class AudioClock  : public Thread
+    {
+    public:
+        AudioClock (AudioProcessor& p, const Soak::Options& o)
+            : Thread ("Soak audio clock"), processor (p), options (o),
+              noise (o.numChannels, o.blockSize), buffer (o.numChannels, o.blockSize)
+        {
+            Random random (0x50a4);
+            for (int chan = 0; chan < options.numChannels; chan++)
+                for (int i = 0; i < options.blockSize; i++)
+                    noise.setSample (chan, i, random.nextFloat() * 2.0f - 1.0f);
+
+            // allocated up front, the audio thread mustn't allocate while it's being measured
+            xrunSeconds.reserve ((size_t) maxListedXruns);
+        }
+
+        void run() override
+        {
+            const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+            const double ticksPerMicrosecond = ticksPerSecond * 1.0e-6;
+            const double blockTicks = options.blockSize / options.sampleRate * ticksPerSecond;
+
+            // kept as an offset in double so the clock doesn't drift by a rounded tick per block
+            const int64 start = Time::getHighResolutionTicks();
+            double due = blockTicks;
+
+            while (! threadShouldExit())
+            {
+                waitUntil (start + (int64) due, ticksPerSecond);
+                const int64 woken = Time::getHighResolutionTicks();
+
+                for (int chan = 0; chan < options.numChannels; chan++)
+                    buffer.copyFrom (chan, 0, noise, chan, 0, options.blockSize);
+
+                processor.processBlock (buffer, midi);
+                const int64 finished = Time::getHighResolutionTicks();
+
+                const double dueTicks = start + due;
+                wakeJitter.add ((woken - dueTicks) / ticksPerMicrosecond);
+                processTime.add ((double) (finished - woken) / ticksPerMicrosecond);
+                callbackLatency.add ((finished - dueTicks) / ticksPerMicrosecond);
+
+                const int64 latencyTicks = finished - (int64) dueTicks;
+                if (latencyTicks > worstLatencyTicks.load (std::memory_order_relaxed))
+                    worstLatencyTicks.store (latencyTicks, std::memory_order_relaxed);
+
+                // the output had to be ready by the time the next callback was due
+                due += blockTicks;
+                if (finished > start + due)
+                {
+                    if (xrunSeconds.size() < (size_t) maxListedXruns)
+                        xrunSeconds.push_back ((finished - start) / ticksPerSecond);
+
+                    numXruns.fetch_add (1, std::memory_order_relaxed);
+
+                    // a device wouldn't call back for periods that have already gone by
+                    while (start + due + blockTicks < finished)
+                    {
+                        due += blockTicks;
+                        numSkippedBlocks.fetch_add (1, std::memory_order_relaxed);
+                    }
+                }
+
+                numBlocks.fetch_add (1, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<int64> numBlocks { 0 };
+        std::atomic<int64> numXruns { 0 };
+        std::atomic<int64> numSkippedBlocks { 0 };
+        std::atomic<int64> worstLatencyTicks { 0 };
+
+        Histogram wakeJitter, processTime, callbackLatency;
+        std::vector<double> xrunSeconds;
+
+    private:
+        // Sleeps most of the way and spins through the last couple of milliseconds,
+        // sleep alone can overshoot by more than a short block
+        void waitUntil (int64 target, double ticksPerSecond)
+        {
+            for (;;)
+            {
+                const double milliseconds = (target - Time::getHighResolutionTicks()) * 1000.0 / ticksPerSecond;
+                if (milliseconds <= 0.0)
+                    return;
+
+                if (milliseconds > 2.0)
+                    Thread::sleep ((int) milliseconds - 1);
+                else
+                    Thread::yield();
+            }
+        }
+
+        AudioProcessor& processor;
+        const Soak::Options options;
+        AudioBuffer<float> noise, buffer;
+        MidiBuffer midi;
+    };
+
+    //==============================================================================
+    // Moves a random gain or crossover every few milliseconds, the way host automation
+    // does. Every crossover move has the designer build new kernels in the background.
+    class Automation  : public Thread
+    {
+    public:
+        Automation (AudioProcessor& processor)
+            : Thread ("Soak automation")
+        {
+            for (auto* parameter : processor.getParameters())
+                if (auto* floatParameter = dynamic_cast<AudioParameterFloat*> (parameter))
+                    parameters.add (floatParameter);
+        }
+
+        void run() override
+        {
+            Random random (0xa070);
+
+            while (! threadShouldExit())
+            {
+                wait (1 + random.nextInt (20));
+
+                if (parameters.size() > 0)
+                {
+                    parameters[random.nextInt (parameters.size())]->setValueNotifyingHost (random.nextFloat());
+                    numChanges.fetch_add (1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::atomic<int64> numChanges { 0 };
+
+    private:
+        Array<AudioParameterFloat*> parameters;
+    };
+
+    //==============================================================================
+    // Makes the open editor's reads at the rates of its timers: the spectrum feed at
+    // 30 Hz, the telemetry at 4 Hz when it is compiled in, and every couple of
+    // seconds the response curve's kernel set and a host saving the session.
+    class EditorReads  : public Thread
+    {
+    public:
+        EditorReads (ParametricEqAudioProcessor& p)
+            : Thread ("Soak editor reads"), processor (p)
+        {
+            pulled.malloc ((size_t) SpectrumFeed::capacity);
+        }
+
+        void run() override
+        {
+            SpectrumFeed& feed = processor.getSpectrumFeed();
+           #if EQ_TELEMETRY
+            BlockTelemetry& telemetry = processor.getTelemetry();
+           #endif
+            feed.setActive (true);
+
+            for (int tick = 0; ! threadShouldExit(); tick++)
+            {
+                wait (33);
+
+                for (int signal = 0; signal < SpectrumFeed::numSignals; signal++)
+                    feed.pull ((SpectrumFeed::Signal) signal, pulled, SpectrumFeed::capacity);
+
+               #if EQ_TELEMETRY
+                if (tick % 8 == 0)
+                {
+                    telemetry.getLoadPercentile (0.99);
+                    telemetry.getMaxLoad();
+                    telemetry.getNumDeadlineMisses();
+                }
+               #endif
+
+                if (tick % 60 == 0)
+                {
+                    kernelCache->release (kernelCache->acquire (processor.getRequestedSettings()));
+
+                    MemoryBlock state;
+                    processor.getStateInformation (state);
+                }
+
+                numReads.fetch_add (1, std::memory_order_relaxed);
+            }
+
+            feed.setActive (false);
+        }
+
+        std::atomic<int64> numReads { 0 };
+
+    private:
+        ParametricEqAudioProcessor& processor;
+        SharedResourcePointer<KernelCache> kernelCache;
+        HeapBlock<float> pulled;
+    };
+
+    //==============================================================================
+    // Reads and writes its way through a buffer far bigger than the caches, over and over
+    class MemoryLoad  : public Thread
+    {
+    public:
+        MemoryLoad()
+            : Thread ("Soak memory load")
+        {
+            data.calloc ((size_t) loadBufferSamples);
+        }
+
+        void run() override
+        {
+            const int chunkSize = 65536;
+
+            while (! threadShouldExit())
+            {
+                for (int start = 0; start < loadBufferSamples && ! threadShouldExit(); start += chunkSize)
+                    for (int i = start; i < start + chunkSize; i++)
+                        data[i] = data[i] * 0.5f + 1.0f;
+
+                numPasses.fetch_add (1, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<int64> numPasses { 0 };
+
+    private:
+        HeapBlock<float> data;
+    };
+}
+
+//==============================================================================
+var Soak::run (const Options& options, bool& passed)
+{
+    ParametricEqAudioProcessor processor;
+    *processor.getChoiceParameter ("mode") = options.mode;
+    *processor.getChoiceParameter ("kernellength") = options.lengthIndex;
+
+    processor.setPlayConfigDetails (options.numChannels, options.numChannels, options.sampleRate, options.blockSize);
+    processor.prepareToPlay (options.sampleRate, options.blockSize);
+
+    AudioClock clock (processor, options);
+    Automation automation (processor);
+    EditorReads editor (processor);
+
+    OwnedArray<MemoryLoad> load;
+    for (int i = 0; i < options.numLoadThreads; i++)
+        load.add (new MemoryLoad())->startThread (5);
+
+    editor.startThread (4);
+    automation.startThread (5);
+
+    // the same priority the plug-in's own channel workers ask for
+    clock.startThread (10);
+
+    const double startMs = Time::getMillisecondCounterHiRes();
+    double nextProgress = progressInterval;
+
+    for (;;)
+    {
+        const double elapsed = (Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+        if (elapsed >= options.seconds)
+            break;
+
+        Thread::sleep (jmax (1, jmin (1000, roundToInt ((options.seconds - elapsed) * 1000.0))));
+
+        if (elapsed >= nextProgress)
+        {
+            std::cerr << "soak, " << roundToInt (elapsed) << " s, " << clock.numBlocks.load() << " blocks, "
+                      << clock.numXruns.load() << " xruns, worst callback "
+                      << Time::highResolutionTicksToSeconds (clock.worstLatencyTicks.load()) * 1000.0 << " ms" << std::endl;
+            nextProgress += progressInterval;
+        }
+    }
+
+    clock.stopThread (4000);
+    automation.stopThread (4000);
+    editor.stopThread (4000);
+    for (auto* thread : load)
+        thread->stopThread (4000);
+
+    processor.releaseResources();
+
+    int64 loadPasses = 0;
+    for (auto* thread : load)
+        loadPasses += thread->numPasses.load();
+
+    var xrunTimes = var::emptyArray();
+    for (double seconds : clock.xrunSeconds)
+        xrunTimes.append (seconds);
+
+    const int64 numXruns = clock.numXruns.load();
+    passed = numXruns == 0;
+
+    DynamicObject* result = new DynamicObject();
+    result->setProperty ("mode", "soak");
+    result->setProperty ("filterMode", options.mode);
+    result->setProperty ("kernelLengthIndex", options.lengthIndex);
+    result->setProperty ("channels", options.numChannels);
+    result->setProperty ("blockSize", options.blockSize);
+    result->setProperty ("sampleRate", options.sampleRate);
+    result->setProperty ("seconds", options.seconds);
+    result->setProperty ("loadThreads", options.numLoadThreads);
+    result->setProperty ("loadPasses", loadPasses);
+    result->setProperty ("blocks", clock.numBlocks.load());
+    result->setProperty ("xruns", numXruns);
+    result->setProperty ("skippedBlocks", clock.numSkippedBlocks.load());
+    result->setProperty ("xrunSeconds", xrunTimes);
+    result->setProperty ("blockMicroseconds", options.blockSize / options.sampleRate * 1.0e6);
+    result->setProperty ("wakeJitterMicroseconds", clock.wakeJitter.toJSON());
+    result->setProperty ("processMicroseconds", clock.processTime.toJSON());
+    result->setProperty ("callbackLatencyMicroseconds", clock.callbackLatency.toJSON());
+    result->setProperty ("automationChanges", automation.numChanges.load());
+    result->setProperty ("editorReads", editor.numReads.load());
+   #if EQ_TELEMETRY
+    result->setProperty ("telemetry", JSON::parse (processor.getTelemetry().toJSON()));
+   #endif
+    result->setProperty ("passed", passed);
+    return var (result);
+}
@@ -0,0 +1,28 @@
+// This is the header for the benchmark's soak test, run with --soak.
+// Average throughput hides the odd late block that clicks in a session, so
+// this drives processBlock from a thread on a simulated audio clock for as
+// long as asked, with parameter automation, editor reads and optional
+// background load running alongside, and reports every callback that
+// missed its deadline along with the worst case and percentiles.
+
+#pragma once
+
+#include "../PluginProcessor.h"
+
+namespace Soak
+{
+    struct Options
+    {
+        double seconds = 60.0;      // wall clock length of the run
+        double sampleRate = 48000.0;
+        int blockSize = 256;
+        int numChannels = 2;
+        int mode = 0;               // index of the mode parameter
+        int lengthIndex = 3;        // index of the kernel length parameter
+        int numLoadThreads = 0;     // threads streaming through memory to compete for the CPU
+    };
+
+    // Runs the soak and returns its results as a JSON object. passed is cleared
+    // if any callback finished after its deadline.
+    var run (const Options& options, bool& passed);
+}
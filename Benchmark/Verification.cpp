@@ -0,0 +1,928 @@
+// This file contains the correctness checks run by Benchmark --verify.
+// The golden reference is the original filtering written out plainly: the
+// designer's three band kernels, mixed with the gains and convolved directly
+// in double precision. Every path renders impulses, sweeps and noise in fixed
+// and random block sizes and has to match it within the tolerances below,
+// and a few of them every block size from 1 sample to 8192.
+// The multirate and IIR paths are different filters by design, so they are
+// checked by their band responses against the ideal gains instead, and so
+// are the band output buses, which also have to sum to the main output.
+// The telemetry has to hold blocks larger and smaller than prepared to
+// their own deadlines.
+// Last, the audio thread is watched for allocations, frees and locks while
+// the parameters move under it, at block sizes from 1 sample to 16384, in
+// every mode and bus layout and across mode, kernel length, preset and A/B
+// switches.
+
+#include "Verification.h"
+#include "RealtimeHooks.h"
+#include "../ChannelWorkerPool.h"
+#include <complex>
+#include <iostream>
+
+namespace
+{
+    // Gains for every render, far enough apart that a band mixed into the wrong place shows
+    const float testGains[3] = { 1.3f, 0.6f, 1.1f };
+
+    // Largest error relative to the reference peak, in dB
+    const double floatDirectToleranceDb = -115.0;
+    const double floatFFTToleranceDb = -110.0;
+    const double doubleToleranceDb = -250.0;
+
+    // Band responses, magnitude error in dB and phase error in degrees
+    const double firMagnitudeToleranceDb = 0.05;
+    const double firPhaseToleranceDegrees = 0.5;
+    const double iirMagnitudeToleranceDb = 0.5;
+
+    // SIMD kernels against the scalar one, in units of the rounding error of the sum
+    // of |coeffs[k]*x[n-k]|. Two correctly rounded sums differ by at most 2*numTaps.
+    const double kernelToleranceFactor = 2.0;
+
+    // One processing path to check
+    struct PathSetup
+    {
+        const char* name;
+        int mode;               // index of the mode parameter
+        int lengthIndex;        // index of the kernel length parameter
+        double sampleRate;
+        bool doublePrecision;
+    };
+
+    // Paths compared sample by sample with the reference convolution
+    const PathSetup samplePaths[] =
+    {
+        { "fir-33",           0, 0, 48000.0, false },
+        { "fir-65",           0, 2, 48000.0, false },
+        { "fir-129",          0, 3, 48000.0, false },
+        { "fft-513",          0, 5, 48000.0, false },
+        { "fft-4097",         0, 8, 48000.0, false },
+        { "double-fir-129",   0, 3, 48000.0, true },
+        { "double-fft-1025",  0, 6, 48000.0, true },
+        { "double-fft-4097",  0, 8, 48000.0, true }
+    };
+
+    // Paths whose band responses are compared with the ideal gains, all with kernels
+    // long enough for the bands to be flat at the test frequencies
+    const PathSetup bandPaths[] =
+    {
+        { "fft-4097",               0, 8, 48000.0,  false },
+        { "multirate-4097",         0, 8, 192000.0, false },
+        { "double-fft-4097",        0, 8, 48000.0,  true },
+        { "double-multirate-2049",  0, 7, 192000.0, true },
+        { "iir",                    1, 3, 48000.0,  false }
+    };
+
+    const char* const signalNames[] = { "impulse", "sweep", "noise" };
+
+    // Paths rendered with the Low, Mid and High output buses on
+    const PathSetup bandOutputPaths[] =
+    {
+        { "fft-4097",         0, 8, 48000.0, false },
+        { "double-fft-4097",  0, 8, 48000.0, true }
+    };
+
+    // Where the band output check moves the low crossover to after prepareToPlay,
+    // and how long the designer thread gets to deliver the new kernels
+    const float movedLowCrossover = 160.0f;
+    const int designTimeoutMs = 10000;
+
+    // Host block size for the fixed block renders, and the largest of the random ones
+    const int fixedBlockSize = 256;
+    const int maxRandomBlockSize = 1024;
+
+    // Paths rendered at every host block size from 1 to maxSweptBlockSize, one prepared
+    // session per size, and once more with sizes varying up to it in one session
+    const PathSetup blockSizePaths[] =
+    {
+        { "fir-129",         0, 3, 48000.0, false },
+        { "fft-513",         0, 5, 48000.0, false },
+        { "double-fir-129",  0, 3, 48000.0, true },
+        { "double-fft-1025", 0, 6, 48000.0, true }
+    };
+
+    const int sweptBlockSizes[] = { 1, 2, 3, 7, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+    const int maxSweptBlockSize = 8192;
+
+    // A path whose audio thread is watched for allocations, frees and locks
+    struct RealtimeSetup
+    {
+        const char* name;
+        PathSetup path;
+        int numChannels;        // on the main buses
+        bool bandOutputs;       // with the Low, Mid and High output buses on
+        bool switchModes;       // also switches the kernel length and mode mid session
+        bool switchPresets;     // also goes through the presets and A/B snapshots
+    };
+
+    // Every path and layout the processor has, each prepared at every one of these block
+    // sizes and once at realtimePreparedBlockSize with random sizes up to the largest,
+    // which the processor has to take in chunks. Sixteen channels are enough for workers.
+    const RealtimeSetup realtimeSetups[] =
+    {
+        { "fir-129",                 { "fir-129",         0, 3, 48000.0,  false },  2, false, false, false },
+        { "fft-4097",                { "fft-4097",        0, 8, 48000.0,  false },  2, false, false, false },
+        { "double-fir-129",          { "double-fir-129",  0, 3, 48000.0,  true },   2, false, false, false },
+        { "double-fft-4097",         { "double-fft-4097", 0, 8, 48000.0,  true },   2, false, false, false },
+        { "multirate-4097",          { "multirate-4097",  0, 8, 192000.0, false },  2, false, false, false },
+        { "iir",                     { "iir",             1, 3, 48000.0,  false },  2, false, false, false },
+        { "band-outputs-fir-129",    { "fir-129",         0, 3, 48000.0,  false },  2, true,  false, false },
+        { "band-outputs-fft-4097",   { "fft-4097",        0, 8, 48000.0,  false },  2, true,  false, false },
+        { "16-channel-fir-129",      { "fir-129",         0, 3, 48000.0,  false }, 16, false, false, false },
+        { "16-channel-fft-4097",     { "fft-4097",        0, 8, 48000.0,  false }, 16, false, false, false },
+        { "mode-and-length-switch",  { "fir-129",         0, 3, 48000.0,  false },  2, false, true,  false },
+        { "double-mode-and-length-switch", { "double-fir-129", 0, 3, 48000.0, true }, 2, false, true,  false },
+        { "preset-and-ab-switch",    { "fir-129",         0, 3, 48000.0,  false },  2, false, false, true },
+        { "fft-preset-and-ab-switch", { "fft-4097",       0, 8, 48000.0,  false },  2, false, false, true }
+    };
+
+    // The other kernel length the switching sessions go to and back from
+    const int switchedLengthIndex = 8;
+
+    const int realtimeBlockSizes[] = { 1, 2, 3, 7, 16, 64, 256, 512, 513, 1024, 4096, 8192, 16384 };
+    const int maxRealtimeBlockSize = 16384;
+    const int realtimePreparedBlockSize = 512;
+
+    // How many samples each realtime session runs for, how often it changes the gains,
+    // and how long it waits after moving a crossover or length for the new kernels to arrive
+    const int realtimeSessionSamples = 32768;
+    const int realtimeGainInterval = 4;
+    const int realtimeDesignWaitMs = 50;
+
+    // How long the preset sessions give the designer to fill its slots after prepareToPlay,
+    // and how many times they change program or toggle A/B
+    const int realtimePresetWaitMs = 300;
+    const int realtimePresetSwitches = 8;
+
+    std::vector<double> makeSignal (int type, int numSamples, double sampleRate)
+    {
+        std::vector<double> signal ((size_t) numSamples, 0.0);
+
+        if (type == 0)
+        {
+            signal[0] = 1.0;
+        }
+        else if (type == 1)
+        {
+            // exponential sweep from 20 Hz to just below Nyquist
+            const double startFrequency = 20.0;
+            const double rate = std::log (0.45 * sampleRate / startFrequency) / numSamples;
+
+            for (int n = 0; n < numSamples; n++)
+            {
+                const double phase = MathConstants<double>::twoPi * startFrequency / sampleRate
+                                       * (std::exp (rate * n) - 1.0) / rate;
+                signal[(size_t) n] = 0.5 * std::sin (phase);
+            }
+        }
+        else
+        {
+            Random random (0x5eed);
+            for (auto& sample : signal)
+                sample = random.nextDouble() - 0.5;
+        }
+
+        return signal;
+    }
+
+    // Output of one render, and what the processor was set to
+    struct Render
+    {
+        std::vector<double> output;
+        KernelSettings settings;
+        int latency = 0;
+    };
+
+    // Renders signal on two channels through a freshly prepared processor, in blocks of
+    // maxBlockSize or random sizes up to it. Returns the first channel.
+    template <typename FloatType>
+    Render render (const PathSetup& path, const std::vector<double>& signal, int maxBlockSize, bool randomBlocks)
+    {
+        ParametricEqAudioProcessor processor;
+        if (path.doublePrecision)
+            processor.setProcessingPrecision (AudioProcessor::doublePrecision);
+
+        *processor.getChoiceParameter ("mode") = path.mode;
+        *processor.getChoiceParameter ("kernellength") = path.lengthIndex;
+        *processor.getFloatParameter ("lowgain") = testGains[0];
+        *processor.getFloatParameter ("midgain") = testGains[1];
+        *processor.getFloatParameter ("higain") = testGains[2];
+
+        processor.setPlayConfigDetails (2, 2, path.sampleRate, maxBlockSize);
+        processor.prepareToPlay (path.sampleRate, maxBlockSize);
+
+        Render result;
+        result.latency = processor.getLatencySamples();
+        result.settings.sampleRate = path.sampleRate;
+        result.settings.lowCrossover = processor.getFloatParameter ("lowfreq")->get();
+        result.settings.highCrossover = processor.getFloatParameter ("highfreq")->get();
+
+        result.settings.length = processor.getChoiceParameter ("kernellength")->choices[path.lengthIndex].getIntValue();
+
+        const int numSamples = (int) signal.size();
+        result.output.resize ((size_t) numSamples);
+
+        Random random (0xb10c);
+        AudioBuffer<FloatType> buffer (2, maxBlockSize);
+        MidiBuffer midi;
+
+        for (int start = 0; start < numSamples;)
+        {
+            const int blockSize = jmin (numSamples - start, randomBlocks ? 1 + random.nextInt (maxBlockSize) : maxBlockSize);
+            buffer.setSize (2, blockSize, false, false, true);
+
+            for (int chan = 0; chan < 2; chan++)
+                for (int i = 0; i < blockSize; i++)
+                    buffer.setSample (chan, i, (FloatType) signal[(size_t) (start + i)]);
+
+            processor.processBlock (buffer, midi);
+
+            for (int i = 0; i < blockSize; i++)
+                result.output[(size_t) (start + i)] = buffer.getSample (0, i);
+
+            start += blockSize;
+        }
+
+        processor.releaseResources();
+        return result;
+    }
+
+    Render render (const PathSetup& path, const std::vector<double>& signal, int maxBlockSize, bool randomBlocks)
+    {
+        return path.doublePrecision ? render<double> (path, signal, maxBlockSize, randomBlocks)
+                                    : render<float> (path, signal, maxBlockSize, randomBlocks);
+    }
+
+    // The golden reference, at the delay of the kernel alone
+    std::vector<double> renderReference (const KernelSettings& settings, const std::vector<double>& signal)
+    {
+        std::unique_ptr<EQKernelSet> kernels (KernelDesigner::design (settings));
+        jassert (kernels->multirate.decimation == 0);
+
+        const int length = kernels->bands.getNumSamples();
+        std::vector<double> kernel ((size_t) length, 0.0);
+        for (int band = 0; band < 3; band++)
+            for (int k = 0; k < length; k++)
+                kernel[(size_t) k] += (double) testGains[band] * kernels->bands.getSample (band, k);
+
+        std::vector<double> output (signal.size(), 0.0);
+        for (size_t n = 0; n < signal.size(); n++)
+        {
+            double sum = 0.0;
+            for (size_t k = 0; k < kernel.size() && k <= n; k++)
+                sum += kernel[k] * signal[n - k];
+
+            output[n] = sum;
+        }
+
+        return output;
+    }
+
+    // Largest difference from the reference relative to its peak, in dB. The output is
+    // shifted back by whatever latency the path adds on top of the kernel's own delay.
+    double getErrorDb (const Render& result, const std::vector<double>& reference)
+    {
+        const size_t extraLatency = (size_t) (result.latency - (result.settings.length - 1) / 2);
+        double peak = 0.0;
+        double error = 0.0;
+
+        for (size_t n = 0; n + extraLatency < result.output.size(); n++)
+        {
+            peak = jmax (peak, std::abs (reference[n]));
+            error = jmax (error, std::abs (result.output[n + extraLatency] - reference[n]));
+        }
+
+        return Decibels::gainToDecibels (error / peak, -400.0);
+    }
+
+    // Frequency response of an impulse response at frequency Hz, with the latency taken out
+    std::complex<double> getResponse (const Render& impulse, double frequency)
+    {
+        const double w = MathConstants<double>::twoPi * frequency / impulse.settings.sampleRate;
+        std::complex<double> sum;
+
+        for (size_t n = 0; n < impulse.output.size(); n++)
+            sum += impulse.output[n] * std::polar (1.0, -w * ((double) n - impulse.latency));
+
+        return sum;
+    }
+
+    // Adds one check to the results and logs it
+    void addResult (var& results, DynamicObject* check, bool passed, bool& allPassed)
+    {
+        check->setProperty ("passed", passed);
+        allPassed = allPassed && passed;
+
+        // the var owns the object from here on
+        const var result (check);
+        std::cerr << (passed ? "pass  " : "FAIL  ") << JSON::toString (result, true) << std::endl;
+        results.append (result);
+    }
+
+    void checkSamples (const PathSetup& path, int numSamples, var& results, bool& allPassed)
+    {
+        const double toleranceDb = path.doublePrecision ? doubleToleranceDb
+                                 : path.lengthIndex >= 4 ? floatFFTToleranceDb
+                                 : floatDirectToleranceDb;
+
+        for (int type = 0; type < 3; type++)
+        {
+            const std::vector<double> signal = makeSignal (type, numSamples, path.sampleRate);
+            std::vector<double> reference;
+
+            for (int blocks = 0; blocks < 2; blocks++)
+            {
+                const bool randomBlocks = blocks == 1;
+                const Render result = render (path, signal, randomBlocks ? maxRandomBlockSize : fixedBlockSize, randomBlocks);
+
+                if (reference.empty())
+                    reference = renderReference (result.settings, signal);
+
+                const double errorDb = getErrorDb (result, reference);
+
+                DynamicObject* check = new DynamicObject();
+                check->setProperty ("check", "samples");
+                check->setProperty ("path", path.name);
+                check->setProperty ("signal", signalNames[type]);
+                check->setProperty ("blocks", randomBlocks ? "random" : "fixed");
+                check->setProperty ("errorDb", errorDb);
+                check->setProperty ("toleranceDb", toleranceDb);
+                addResult (results, check, errorDb <= toleranceDb, allPassed);
+            }
+        }
+    }
+
+    // The delay line and the chunking of big blocks against the reference, for tiny
+    // blocks, blocks far past the FIR and FFT sizes, and a host that changes size every call
+    void checkBlockSizes (const PathSetup& path, int numSamples, var& results, bool& allPassed)
+    {
+        const double toleranceDb = path.doublePrecision ? doubleToleranceDb
+                                 : path.lengthIndex >= 4 ? floatFFTToleranceDb
+                                 : floatDirectToleranceDb;
+
+        const std::vector<double> signal = makeSignal (2, numSamples, path.sampleRate);
+        std::vector<double> reference;
+        double worstErrorDb = -400.0;
+        int worstBlockSize = 0;
+
+        for (int blockSize : sweptBlockSizes)
+        {
+            const Render result = render (path, signal, blockSize, false);
+
+            if (reference.empty())
+                reference = renderReference (result.settings, signal);
+
+            const double errorDb = getErrorDb (result, reference);
+            if (errorDb >= worstErrorDb)
+            {
+                worstErrorDb = errorDb;
+                worstBlockSize = blockSize;
+            }
+        }
+
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "block-sizes");
+        check->setProperty ("path", path.name);
+        check->setProperty ("blocks", "1 to " + String (maxSweptBlockSize));
+        check->setProperty ("errorDb", worstErrorDb);
+        check->setProperty ("worstBlockSize", worstBlockSize);
+        check->setProperty ("toleranceDb", toleranceDb);
+        addResult (results, check, worstErrorDb <= toleranceDb, allPassed);
+
+        const double randomErrorDb = getErrorDb (render (path, signal, maxSweptBlockSize, true), reference);
+
+        check = new DynamicObject();
+        check->setProperty ("check", "block-sizes");
+        check->setProperty ("path", path.name);
+        check->setProperty ("blocks", "random up to " + String (maxSweptBlockSize));
+        check->setProperty ("errorDb", randomErrorDb);
+        check->setProperty ("toleranceDb", toleranceDb);
+        addResult (results, check, randomErrorDb <= toleranceDb, allPassed);
+    }
+
+    void checkBands (const PathSetup& path, int numSamples, var& results, bool& allPassed)
+    {
+        const Render impulse = render (path, makeSignal (0, numSamples, path.sampleRate), fixedBlockSize, false);
+        const double low = impulse.settings.lowCrossover;
+        const double high = impulse.settings.highCrossover;
+
+        // well inside each band, clear of both crossovers
+        const double frequencies[3] = { 0.25 * low, std::sqrt (low * high), jmin (3.0 * high, 0.4 * path.sampleRate) };
+        const char* const bandNames[3] = { "low", "mid", "high" };
+        const bool isIIR = path.mode == 1;
+
+        for (int band = 0; band < 3; band++)
+        {
+            const std::complex<double> response = getResponse (impulse, frequencies[band]);
+            const double magnitudeDb = Decibels::gainToDecibels (std::abs (response), -400.0);
+            const double expectedDb = Decibels::gainToDecibels ((double) testGains[band]);
+            const double phaseDegrees = radiansToDegrees (std::arg (response));
+
+            const double magnitudeTolerance = isIIR ? iirMagnitudeToleranceDb : firMagnitudeToleranceDb;
+            bool passed = std::abs (magnitudeDb - expectedDb) <= magnitudeTolerance;
+
+            // the IIR crossover isn't linear phase, so only its magnitude is checked
+            if (! isIIR)
+                passed = passed && std::abs (phaseDegrees) <= firPhaseToleranceDegrees;
+
+            DynamicObject* check = new DynamicObject();
+            check->setProperty ("check", "band");
+            check->setProperty ("path", path.name);
+            check->setProperty ("band", bandNames[band]);
+            check->setProperty ("frequency", frequencies[band]);
+            check->setProperty ("magnitudeDb", magnitudeDb);
+            check->setProperty ("expectedDb", expectedDb);
+            check->setProperty ("magnitudeToleranceDb", magnitudeTolerance);
+            check->setProperty ("phaseDegrees", phaseDegrees);
+            if (! isIIR)
+                check->setProperty ("phaseToleranceDegrees", firPhaseToleranceDegrees);
+            addResult (results, check, passed, allPassed);
+        }
+    }
+
+    // Main output and the three band outputs of the first channel
+    struct BandRender
+    {
+        Render outputs[4];
+    };
+
+    // Renders signal through a processor prepared with every output bus on, and
+    // keeps its state, so it can be called again after a parameter change
+    template <typename FloatType>
+    BandRender renderBandOutputs (ParametricEqAudioProcessor& processor, const std::vector<double>& signal)
+    {
+        const int numChannels = 8;
+        const int numSamples = (int) signal.size();
+
+        BandRender result;
+        for (Render& output : result.outputs)
+        {
+            output.output.resize ((size_t) numSamples);
+            output.settings = processor.getRequestedSettings();
+            output.latency = processor.getLatencySamples();
+        }
+
+        AudioBuffer<FloatType> buffer (numChannels, fixedBlockSize);
+        MidiBuffer midi;
+
+        for (int start = 0; start < numSamples; start += fixedBlockSize)
+        {
+            const int blockSize = jmin (numSamples - start, fixedBlockSize);
+            buffer.setSize (numChannels, blockSize, false, false, true);
+
+            // the band channels are filled with junk, the processor has to overwrite all of it
+            for (int chan = 0; chan < numChannels; chan++)
+                for (int i = 0; i < blockSize; i++)
+                    buffer.setSample (chan, i, chan < 2 ? (FloatType) signal[(size_t) (start + i)] : (FloatType) 100);
+
+            processor.processBlock (buffer, midi);
+
+            for (int bus = 0; bus < 4; bus++)
+                for (int i = 0; i < blockSize; i++)
+                    result.outputs[bus].output[(size_t) (start + i)] = buffer.getSample (2 * bus, i);
+        }
+
+        return result;
+    }
+
+    // Magnitude of one output's response at frequency Hz, in dB
+    double getMagnitudeDb (const Render& impulse, double frequency)
+    {
+        return Decibels::gainToDecibels (std::abs (getResponse (impulse, frequency)), -400.0);
+    }
+
+    // With the band output buses on, each band has to carry its own gain and the three
+    // have to sum to the main output. The low crossover is moved after prepareToPlay, so
+    // the bands are checked on kernels the designer thread made for them.
+    template <typename FloatType>
+    void checkBandOutputs (const PathSetup& path, int numSamples, var& results, bool& allPassed)
+    {
+        ParametricEqAudioProcessor processor;
+        if (path.doublePrecision)
+            processor.setProcessingPrecision (AudioProcessor::doublePrecision);
+
+        *processor.getChoiceParameter ("mode") = path.mode;
+        *processor.getChoiceParameter ("kernellength") = path.lengthIndex;
+        *processor.getFloatParameter ("lowgain") = testGains[0];
+        *processor.getFloatParameter ("midgain") = testGains[1];
+        *processor.getFloatParameter ("higain") = testGains[2];
+
+        processor.setPlayConfigDetails (2, 2, path.sampleRate, fixedBlockSize);
+        processor.enableAllBuses();
+        processor.prepareToPlay (path.sampleRate, fixedBlockSize);
+
+        const double oldLow = processor.getFloatParameter ("lowfreq")->get();
+        const double high = processor.getFloatParameter ("highfreq")->get();
+        *processor.getFloatParameter ("lowfreq") = movedLowCrossover;
+
+        // between the old and new crossover, mid band only once the new kernels are running
+        const double movedFrequency = std::sqrt (oldLow * movedLowCrossover);
+        const double midGainDb = Decibels::gainToDecibels ((double) testGains[1]);
+
+        const std::vector<double> impulse = makeSignal (0, numSamples, path.sampleRate);
+        const uint32 deadline = Time::getMillisecondCounter() + (uint32) designTimeoutMs;
+        BandRender render = renderBandOutputs<FloatType> (processor, impulse);
+
+        while (std::abs (getMagnitudeDb (render.outputs[2], movedFrequency) - midGainDb) > firMagnitudeToleranceDb
+               && Time::getMillisecondCounter() < deadline)
+        {
+            Thread::sleep (10);
+            render = renderBandOutputs<FloatType> (processor, impulse);
+        }
+
+        processor.releaseResources();
+
+        // largest difference between the sum of the bands and the main output
+        double peak = 0.0;
+        double error = 0.0;
+        for (int n = 0; n < numSamples; n++)
+        {
+            double sum = 0.0;
+            for (int band = 1; band < 4; band++)
+                sum += render.outputs[band].output[(size_t) n];
+
+            peak = jmax (peak, std::abs (render.outputs[0].output[(size_t) n]));
+            error = jmax (error, std::abs (sum - render.outputs[0].output[(size_t) n]));
+        }
+
+        const double sumErrorDb = Decibels::gainToDecibels (error / peak, -400.0);
+        const double toleranceDb = path.doublePrecision ? doubleToleranceDb : floatFFTToleranceDb;
+
+        // each band's own gain well inside it, and the mid band's at the moved crossover
+        const double frequencies[4] = { 0.25 * movedLowCrossover, std::sqrt (movedLowCrossover * high),
+                                        jmin (3.0 * high, 0.4 * path.sampleRate), movedFrequency };
+        const int bands[4] = { 0, 1, 2, 1 };
+        double worstMagnitudeError = 0.0;
+        for (int i = 0; i < 4; i++)
+        {
+            const double magnitudeDb = getMagnitudeDb (render.outputs[1 + bands[i]], frequencies[i]);
+            worstMagnitudeError = jmax (worstMagnitudeError,
+                                        std::abs (magnitudeDb - Decibels::gainToDecibels ((double) testGains[bands[i]])));
+        }
+
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "band-outputs");
+        check->setProperty ("path", path.name);
+        check->setProperty ("lowCrossover", movedLowCrossover);
+        check->setProperty ("sumErrorDb", sumErrorDb);
+        check->setProperty ("toleranceDb", toleranceDb);
+        check->setProperty ("magnitudeErrorDb", worstMagnitudeError);
+        check->setProperty ("magnitudeToleranceDb", firMagnitudeToleranceDb);
+        addResult (results, check, sumErrorDb <= toleranceDb && worstMagnitudeError <= firMagnitudeToleranceDb, allPassed);
+    }
+
+    // Telemetry measures each block against its own length. A host block four times the
+    // prepared size, which processBlock takes in chunks, has four times as long before it
+    // is late, and one a quarter of the size a quarter as long.
+    void checkTelemetry (var& results, bool& allPassed)
+    {
+        const double sampleRate = 48000.0;
+        const int preparedBlockSize = 512;
+        const float deadline = 0.5f;
+
+        BlockTelemetry telemetry;
+        telemetry.prepare (sampleRate, preparedBlockSize);
+        telemetry.setDeadlineFraction (deadline);
+
+        const double sampleTicks = (double) Time::getHighResolutionTicksPerSecond() / sampleRate;
+        auto blockAtLoad = [&] (int numSamples, double load)
+        {
+            telemetry.addBlock ((int64) (load * numSamples * sampleTicks), numSamples);
+        };
+
+        // on time, though over the deadline of a prepared block, then late, though under it
+        blockAtLoad (4 * preparedBlockSize, 0.4);
+        blockAtLoad (preparedBlockSize / 4, 0.6);
+
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "telemetry");
+        check->setProperty ("blocks", telemetry.getNumBlocks());
+        check->setProperty ("deadlineMisses", telemetry.getNumDeadlineMisses());
+        check->setProperty ("loadMax", telemetry.getMaxLoad());
+        addResult (results, check, telemetry.getNumBlocks() == 2 && telemetry.getNumDeadlineMisses() == 1
+                                     && std::abs (telemetry.getMaxLoad() - 0.6) < 0.01, allPassed);
+    }
+
+    // Runs one session on the path and counts what its processBlock calls allocate, free
+    // and lock. The gains change every few blocks and the low crossover moves twice, with
+    // a pause for the designer thread, so adopting and retiring kernels is watched too.
+    // The switching sessions also go to the other kernel length and through the IIR mode,
+    // which reloads the filter structure and changes the latency on the audio thread.
+    // The preset sessions go through the programs and toggle A/B, which the audio thread
+    // switches to from the designer's precomputed slots.
+    // Only processBlock is watched, the parameter changes are the host's business.
+    template <typename FloatType>
+    RealtimeHooks::Counts runRealtimeSession (const RealtimeSetup& setup, int preparedBlockSize,
+                                              int maxBlockSize, bool randomBlocks)
+    {
+        const PathSetup& path = setup.path;
+
+        ParametricEqAudioProcessor processor;
+        if (path.doublePrecision)
+            processor.setProcessingPrecision (AudioProcessor::doublePrecision);
+
+        *processor.getChoiceParameter ("mode") = path.mode;
+        *processor.getChoiceParameter ("kernellength") = path.lengthIndex;
+        processor.setPlayConfigDetails (setup.numChannels, setup.numChannels, path.sampleRate, preparedBlockSize);
+        if (setup.bandOutputs)
+            processor.enableAllBuses();
+        processor.prepareToPlay (path.sampleRate, preparedBlockSize);
+
+        if (setup.switchPresets)
+            Thread::sleep (realtimePresetWaitMs);
+
+        const float oldLow = processor.getFloatParameter ("lowfreq")->get();
+        const int numBlocks = jmax (16, realtimeSessionSamples / maxBlockSize);
+        const int numChannels = setup.numChannels * (setup.bandOutputs ? 4 : 1);
+        const std::vector<double> noise = makeSignal (2, maxBlockSize, path.sampleRate);
+
+        Random random (0x7ea1);
+        AudioBuffer<FloatType> buffer (numChannels, maxBlockSize);
+        MidiBuffer midi;
+        RealtimeHooks::takeCounts();
+        RealtimeHooks::Counts total;
+
+        for (int block = 0; block < numBlocks; block++)
+        {
+            if (block % realtimeGainInterval == 0)
+            {
+                const float scale = (block / realtimeGainInterval) % 2 == 0 ? 1.0f : 0.5f;
+                *processor.getFloatParameter ("lowgain") = scale * testGains[0];
+                *processor.getFloatParameter ("midgain") = scale * testGains[1];
+                *processor.getFloatParameter ("higain") = scale * testGains[2];
+            }
+
+            const bool movesKernels = block == numBlocks / 4 || block == numBlocks / 2;
+            if (movesKernels)
+            {
+                *processor.getFloatParameter ("lowfreq") = block == numBlocks / 4 ? movedLowCrossover : oldLow;
+
+                if (setup.switchModes)
+                {
+                    *processor.getChoiceParameter ("kernellength") = block == numBlocks / 4 ? switchedLengthIndex : path.lengthIndex;
+                    *processor.getChoiceParameter ("mode") = block == numBlocks / 4 ? path.mode : 1;
+                }
+            }
+
+            // every other switch changes program, the rest toggle A/B
+            const int presetInterval = numBlocks / (realtimePresetSwitches + 1);
+            if (setup.switchPresets && block > 0 && block % presetInterval == 0)
+            {
+                const int switchIndex = block / presetInterval;
+                if (switchIndex % 2 == 0)
+                    processor.setCurrentProgram (switchIndex % processor.getNumPrograms());
+                else
+                    processor.toggleAB();
+            }
+
+            // back from the IIR mode, at the original length
+            const bool leavesIIR = setup.switchModes && block == 3 * numBlocks / 4;
+            if (leavesIIR)
+                *processor.getChoiceParameter ("mode") = path.mode;
+
+            const int blockSize = randomBlocks ? 1 + random.nextInt (maxBlockSize) : maxBlockSize;
+            buffer.setSize (numChannels, blockSize, false, false, true);
+
+            for (int chan = 0; chan < numChannels; chan++)
+                for (int i = 0; i < blockSize; i++)
+                    buffer.setSample (chan, i, (FloatType) noise[(size_t) i]);
+
+            RealtimeHooks::setWatching (true);
+            processor.processBlock (buffer, midi);
+            RealtimeHooks::setWatching (false);
+
+            const RealtimeHooks::Counts counts = RealtimeHooks::takeCounts();
+            total.allocations += counts.allocations;
+            total.frees += counts.frees;
+            total.locks += counts.locks;
+
+            // the block above asked the designer for the new kernels, give it time to deliver
+            if (movesKernels || leavesIIR)
+                Thread::sleep (realtimeDesignWaitMs);
+        }
+
+        processor.releaseResources();
+        return total;
+    }
+
+    RealtimeHooks::Counts runRealtimeSession (const RealtimeSetup& setup, int preparedBlockSize,
+                                              int maxBlockSize, bool randomBlocks)
+    {
+        return setup.path.doublePrecision ? runRealtimeSession<double> (setup, preparedBlockSize, maxBlockSize, randomBlocks)
+                                          : runRealtimeSession<float> (setup, preparedBlockSize, maxBlockSize, randomBlocks);
+    }
+
+    void addRealtimeResult (const RealtimeSetup& setup, const String& blocks, const RealtimeHooks::Counts& counts,
+                            int worstBlockSize, var& results, bool& allPassed)
+    {
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "realtime");
+        check->setProperty ("path", setup.name);
+        check->setProperty ("blocks", blocks);
+        check->setProperty ("allocations", counts.allocations);
+        check->setProperty ("frees", counts.frees);
+        check->setProperty ("locks", counts.locks);
+        if (worstBlockSize > 0)
+            check->setProperty ("worstBlockSize", worstBlockSize);
+        addResult (results, check, counts.allocations == 0 && counts.frees == 0 && counts.locks == 0, allPassed);
+    }
+
+    // Nothing the audio thread does may allocate, free or lock, at any block size
+    void checkRealtime (const RealtimeSetup& setup, var& results, bool& allPassed)
+    {
+        RealtimeHooks::Counts total;
+        int worstBlockSize = 0;
+        int worstCount = 0;
+
+        for (int blockSize : realtimeBlockSizes)
+        {
+            const RealtimeHooks::Counts counts = runRealtimeSession (setup, blockSize, blockSize, false);
+            total.allocations += counts.allocations;
+            total.frees += counts.frees;
+            total.locks += counts.locks;
+
+            const int count = counts.allocations + counts.frees + counts.locks;
+            if (count > worstCount)
+            {
+                worstCount = count;
+                worstBlockSize = blockSize;
+            }
+        }
+
+        addRealtimeResult (setup, "1 to " + String (maxRealtimeBlockSize), total, worstBlockSize, results, allPassed);
+
+        const RealtimeHooks::Counts counts = runRealtimeSession (setup, realtimePreparedBlockSize, maxRealtimeBlockSize, true);
+        addRealtimeResult (setup, "random up to " + String (maxRealtimeBlockSize) + " prepared at "
+                                   + String (realtimePreparedBlockSize), counts, 0, results, allPassed);
+    }
+
+    // Counts how often each item of a worker pool run was called
+    void countPoolItem (void* context, int item)
+    {
+        static_cast<std::atomic<int>*> (context)[item].fetch_add (1);
+    }
+
+    // The worker pool on its own, so it's covered on machines with too few cores for
+    // the processor to start workers. Every few runs the workers are left long enough
+    // to fall asleep, so both waking a spinning worker and a sleeping one are watched.
+    void checkWorkerPool (var& results, bool& allPassed)
+    {
+        const int numWorkers = 3;
+        const int numItems = 8;
+        const int numRuns = 2000;
+
+        ChannelWorkerPool pool;
+        pool.setNumWorkers (numWorkers);
+
+        std::atomic<int> calls[numItems];
+        RealtimeHooks::Counts total;
+        int numMissed = 0;
+        RealtimeHooks::takeCounts();
+
+        for (int run = 0; run < numRuns; run++)
+        {
+            for (auto& count : calls)
+                count = 0;
+
+            if (run % 50 == 0)
+                Thread::sleep (20);
+
+            RealtimeHooks::setWatching (true);
+            pool.run (countPoolItem, calls, numItems);
+            RealtimeHooks::setWatching (false);
+
+            const RealtimeHooks::Counts counts = RealtimeHooks::takeCounts();
+            total.allocations += counts.allocations;
+            total.frees += counts.frees;
+            total.locks += counts.locks;
+
+            for (auto& count : calls)
+                numMissed += count != 1 ? 1 : 0;
+        }
+
+        pool.setNumWorkers (0);
+
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "realtime");
+        check->setProperty ("path", "worker-pool");
+        check->setProperty ("workers", numWorkers);
+        check->setProperty ("runs", numRuns);
+        check->setProperty ("allocations", total.allocations);
+        check->setProperty ("frees", total.frees);
+        check->setProperty ("locks", total.locks);
+        check->setProperty ("itemsNotRunOnce", numMissed);
+        addResult (results, check, total.allocations == 0 && total.frees == 0 && total.locks == 0
+                                     && numMissed == 0, allPassed);
+    }
+
+    // The kernels picked for this CPU against processScalar, for symmetric
+    // coefficients and block sizes that exercise every tail loop
+    template <typename FloatType>
+    void checkKernels (const char* name, FIRKernels::ProcessFunction<FloatType> (*getKernel) (int),
+                       var& results, bool& allPassed)
+    {
+        const int tapCounts[] = { 33, 41, 65, 97, 129, 257 };
+        const int blockSizes[] = { 1, 3, 8, 13, 31, 64, 257 };
+        const int maxBlockSize = 257;
+
+        Random random (0xf1f0);
+        double worstRatio = 0.0;
+
+        for (int numTaps : tapCounts)
+        {
+            std::vector<FloatType> coeffs ((size_t) numTaps);
+            for (int k = 0; k <= numTaps / 2; k++)
+                coeffs[(size_t) k] = coeffs[(size_t) (numTaps - 1 - k)] = (FloatType) (random.nextDouble() - 0.5);
+
+            std::vector<FloatType> input ((size_t) (numTaps - 1 + maxBlockSize));
+            for (auto& sample : input)
+                sample = (FloatType) (random.nextDouble() - 0.5);
+
+            const FloatType* x = input.data() + numTaps - 1;
+            FIRKernels::ProcessFunction<FloatType> kernel = getKernel (numTaps);
+
+            for (int blockSize : blockSizes)
+            {
+                std::vector<FloatType> expected ((size_t) blockSize), output ((size_t) blockSize);
+                FIRKernels::processScalar (x, expected.data(), blockSize, coeffs.data(), numTaps);
+                kernel (x, output.data(), blockSize, coeffs.data(), numTaps);
+
+                for (int n = 0; n < blockSize; n++)
+                {
+                    double absoluteSum = 0.0;
+                    for (int k = 0; k < numTaps; k++)
+                        absoluteSum += std::abs ((double) coeffs[(size_t) k] * x[n - k]);
+
+                    const double rounding = std::numeric_limits<FloatType>::epsilon() * absoluteSum;
+                    const double error = std::abs ((double) output[(size_t) n] - expected[(size_t) n]);
+                    worstRatio = jmax (worstRatio, error / (rounding * numTaps));
+                }
+            }
+        }
+
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "kernel");
+        check->setProperty ("path", name);
+        check->setProperty ("errorPerTap", worstRatio);
+        check->setProperty ("tolerance", kernelToleranceFactor);
+        addResult (results, check, worstRatio <= kernelToleranceFactor, allPassed);
+    }
+
+    template <typename FloatType>
+    FIRKernels::ProcessFunction<FloatType> getBestKernel (int)
+    {
+        return FIRKernels::getBestProcessFunction<FloatType>();
+    }
+}
+
+//==============================================================================
+var Verification::runAll (bool quick, bool& allPassed)
+{
+    // long enough for the longest kernel plus an FFT partition of latency
+    const int numSamples = quick ? 16384 : 65536;
+
+    var results = var::emptyArray();
+    allPassed = true;
+
+    checkKernels<float> ("float-best", getBestKernel<float>, results, allPassed);
+    checkKernels<float> ("float-symmetric", FIRKernels::getSymmetricProcessFunction<float>, results, allPassed);
+    checkKernels<double> ("double-best", getBestKernel<double>, results, allPassed);
+    checkKernels<double> ("double-symmetric", FIRKernels::getSymmetricProcessFunction<double>, results, allPassed);
+
+    for (const PathSetup& path : samplePaths)
+        checkSamples (path, numSamples, results, allPassed);
+
+    for (const PathSetup& path : blockSizePaths)
+        checkBlockSizes (path, numSamples, results, allPassed);
+
+    for (const PathSetup& path : bandPaths)
+        checkBands (path, numSamples, results, allPassed);
+
+    for (const PathSetup& path : bandOutputPaths)
+    {
+        if (path.doublePrecision)
+            checkBandOutputs<double> (path, numSamples, results, allPassed);
+        else
+            checkBandOutputs<float> (path, numSamples, results, allPassed);
+    }
+
+    checkTelemetry (results, allPassed);
+
+    if (RealtimeHooks::isAvailable())
+    {
+        for (const RealtimeSetup& setup : realtimeSetups)
+            checkRealtime (setup, results, allPassed);
+
+        checkWorkerPool (results, allPassed);
+    }
+    else
+    {
+        // nothing to count with on this platform or in a sanitizer build
+        DynamicObject* check = new DynamicObject();
+        check->setProperty ("check", "realtime");
+        check->setProperty ("available", false);
+        addResult (results, check, true, allPassed);
+    }
+
+    return results;
+}
@@ -0,0 +1,15 @@
+// This is the header for the benchmark's correctness checks, run with --verify.
+// Every processing path is compared with a golden reference render, so an
+// optimisation that changes the output beyond rounding fails before anyone
+// gets to time it.
+
+#pragma once
+
+#include "../PluginProcessor.h"
+
+namespace Verification
+{
+    // Runs every check and returns one JSON object per check. allPassed is
+    // cleared if any of them is outside its tolerance.
+    var runAll (bool quick, bool& allPassed);
+}
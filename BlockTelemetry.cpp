@@ -0,0 +1,147 @@
+// This file contains the processBlock telemetry. The audio thread is the
+// only writer, so counters are bumped with a relaxed load and store rather
+// than a locked read-modify-write, and a reset asked for by another thread
+// is carried out by the audio thread itself.
+
+#include "BlockTelemetry.h"
+
+namespace
+{
+    // Load at the bottom of the first bucket
+    const double minBucketLoad = 1.0 / 1024.0;
+
+    // Bumps a counter that only this thread writes
+    inline void increment (std::atomic<int64>& counter, int64 amount = 1)
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+}
+
+//==============================================================================
+BlockTelemetry::BlockTelemetry()
+{
+    for (int bucket = 0; bucket < numBuckets; bucket++)
+        buckets[bucket] = 0;
+}
+
+BlockTelemetry::~BlockTelemetry() {}
+
+void BlockTelemetry::prepare (double sampleRate, int samplesPerBlock)
+{
+    sampleTicks = (double) Time::getHighResolutionTicksPerSecond() / sampleRate;
+    blockTicks = samplesPerBlock * sampleTicks.load();
+    reset();
+}
+
+void BlockTelemetry::setDeadlineFraction (float fraction)
+{
+    deadlineFraction = jmax (0.01f, fraction);
+}
+
+void BlockTelemetry::addBlock (int64 ticks, int numSamples)
+{
+    if (resetRequested.exchange (false))
+    {
+        for (int bucket = 0; bucket < numBuckets; bucket++)
+            buckets[bucket].store (0, std::memory_order_relaxed);
+
+        numBlocks.store (0, std::memory_order_relaxed);
+        numDeadlineMisses.store (0, std::memory_order_relaxed);
+        totalTicks.store (0, std::memory_order_relaxed);
+        maxTicks.store (0, std::memory_order_relaxed);
+        maxLoad.store (0.0, std::memory_order_relaxed);
+    }
+
+    const double duration = numSamples * sampleTicks.load (std::memory_order_relaxed);
+    if (duration <= 0.0)
+        return;
+
+    const double load = ticks / duration;
+    const int bucket = load > minBucketLoad ? jmin (numBuckets - 1, (int) (bucketsPerOctave * std::log2 (load / minBucketLoad)))
+                                            : 0;
+
+    increment (buckets[bucket]);
+    increment (numBlocks);
+    increment (totalTicks, ticks);
+
+    if (ticks > maxTicks.load (std::memory_order_relaxed))
+        maxTicks.store (ticks, std::memory_order_relaxed);
+
+    if (load > maxLoad.load (std::memory_order_relaxed))
+        maxLoad.store (load, std::memory_order_relaxed);
+
+    if (load > deadlineFraction.load (std::memory_order_relaxed))
+        increment (numDeadlineMisses);
+}
+
+void BlockTelemetry::reset()
+{
+    resetRequested = true;
+}
+
+double BlockTelemetry::getBucketLoad (int bucket)
+{
+    return minBucketLoad * std::pow (2.0, bucket / (double) bucketsPerOctave);
+}
+
+double BlockTelemetry::getMaxLoad() const
+{
+    return maxLoad.load (std::memory_order_relaxed);
+}
+
+double BlockTelemetry::getLoadPercentile (double fraction) const
+{
+    int64 counts[numBuckets];
+    int64 total = 0;
+    for (int bucket = 0; bucket < numBuckets; bucket++)
+        total += counts[bucket] = buckets[bucket].load (std::memory_order_relaxed);
+
+    if (total == 0)
+        return 0.0;
+
+    // the top edge of the bucket the percentile falls in
+    const int64 target = jmax ((int64) 1, (int64) std::ceil (fraction * (double) total));
+    int64 count = 0;
+
+    for (int bucket = 0; bucket < numBuckets; bucket++)
+    {
+        count += counts[bucket];
+        if (count >= target)
+            return bucket < numBuckets - 1 ? getBucketLoad (bucket + 1) : getMaxLoad();
+    }
+
+    return getMaxLoad();
+}
+
+String BlockTelemetry::toJSON() const
+{
+    const double ticksPerMicrosecond = (double) Time::getHighResolutionTicksPerSecond() * 1.0e-6;
+    const int64 blocks = getNumBlocks();
+
+    var histogram = var::emptyArray();
+    for (int bucket = 0; bucket < numBuckets; bucket++)
+    {
+        const int64 count = buckets[bucket].load (std::memory_order_relaxed);
+        if (count == 0)
+            continue;
+
+        DynamicObject* entry = new DynamicObject();
+        entry->setProperty ("loadFrom", bucket == 0 ? 0.0 : getBucketLoad (bucket));
+        entry->setProperty ("loadTo", bucket == numBuckets - 1 ? getMaxLoad() : getBucketLoad (bucket + 1));
+        entry->setProperty ("blocks", count);
+        histogram.append (var (entry));
+    }
+
+    DynamicObject* report = new DynamicObject();
+    report->setProperty ("blocks", blocks);
+    report->setProperty ("deadlineFraction", getDeadlineFraction());
+    report->setProperty ("deadlineMisses", getNumDeadlineMisses());
+    report->setProperty ("blockMicroseconds", blockTicks.load() / ticksPerMicrosecond);
+    report->setProperty ("meanMicroseconds", blocks > 0 ? totalTicks.load() / ticksPerMicrosecond / (double) blocks : 0.0);
+    report->setProperty ("maxMicroseconds", maxTicks.load() / ticksPerMicrosecond);
+    report->setProperty ("loadP50", getLoadPercentile (0.5));
+    report->setProperty ("loadP99", getLoadPercentile (0.99));
+    report->setProperty ("loadMax", getMaxLoad());
+    report->setProperty ("loadHistogram", histogram);
+    return JSON::toString (var (report));
+}
@@ -0,0 +1,86 @@
+// This is the header for the processBlock telemetry.
+// Every block's processing time goes into a histogram of DSP load, the
+// fraction of the block's own duration spent processing it, and blocks over
+// the deadline are counted. When a session glitches, this tells whether
+// the EQ was the one running late.
+//
+// Only the audio thread writes. Everything is a plain atomic, so the
+// editor can read it at any time without locks. Build with EQ_TELEMETRY
+// set to 0 to compile it out of processBlock entirely.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#ifndef EQ_TELEMETRY
+ #define EQ_TELEMETRY 1
+#endif
+
+class BlockTelemetry
+{
+public:
+    BlockTelemetry();
+    ~BlockTelemetry();
+
+    // Log spaced load buckets, four per octave from 0.1% to 400%
+    static const int bucketsPerOctave = 4;
+    static const int numBuckets = 49;
+
+    // Times one processBlock call of numSamples from construction to destruction
+    struct ScopedBlockTimer
+    {
+        ScopedBlockTimer (BlockTelemetry& t, int n) : telemetry (t), numSamples (n), start (Time::getHighResolutionTicks()) {}
+        ~ScopedBlockTimer() { telemetry.addBlock (Time::getHighResolutionTicks() - start, numSamples); }
+
+        BlockTelemetry& telemetry;
+        const int numSamples;
+        const int64 start;
+    };
+
+    // Sets the sample rate that block durations are worked out from. The prepared
+    // block size is only reported, each block is measured against its own length.
+    void prepare (double sampleRate, int samplesPerBlock);
+
+    // Blocks taking longer than this fraction of their duration count as deadline misses
+    void setDeadlineFraction (float fraction);
+    float getDeadlineFraction() const { return deadlineFraction.load(); }
+
+    // Audio thread: records one block of numSamples that took the given number of
+    // high resolution ticks. Hosts may send fewer samples than prepared, or more,
+    // which processBlock takes in chunks, and either way the block has its own deadline.
+    void addBlock (int64 ticks, int numSamples);
+
+    // Any thread: asks the audio thread to start counting from zero at its next block
+    void reset();
+
+    int64 getNumBlocks() const { return numBlocks.load (std::memory_order_relaxed); }
+    int64 getNumDeadlineMisses() const { return numDeadlineMisses.load (std::memory_order_relaxed); }
+
+    // Load of the slowest block so far, 1 is the whole block duration
+    double getMaxLoad() const;
+
+    // Load that the given fraction of blocks stayed under, to the resolution of the buckets
+    double getLoadPercentile (double fraction) const;
+
+    // Everything above as a JSON object, for bug reports
+    String toJSON() const;
+
+private:
+    // Lower edge of a bucket's load range
+    static double getBucketLoad (int bucket);
+
+    // Duration of a sample, and of the prepared block size, in high resolution ticks
+    std::atomic<double> sampleTicks { 0.0 };
+    std::atomic<double> blockTicks { 0.0 };
+    std::atomic<float> deadlineFraction { 0.5f };
+    std::atomic<bool> resetRequested { false };
+
+    std::atomic<int64> buckets[numBuckets];
+    std::atomic<int64> numBlocks { 0 };
+    std::atomic<int64> numDeadlineMisses { 0 };
+    std::atomic<int64> totalTicks { 0 };
+    std::atomic<int64> maxTicks { 0 };
+    std::atomic<double> maxLoad { 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BlockTelemetry)
+};
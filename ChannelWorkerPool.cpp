@@ -0,0 +1,182 @@
+// This file contains the worker pool used to process channel groups in parallel.
+// Between blocks the workers spin on the generation counter for a little while,
+// then sleep on a semaphore. run() publishes the job, bumps the generation, posts
+// to the workers that are asleep, then claims items itself until none are left,
+// and finally spins until the items the workers claimed are done.
+// JUCE's WaitableEvent isn't used for the wake-up as signalling it takes a mutex.
+
+#include "ChannelWorkerPool.h"
+
+#if JUCE_WINDOWS
+ #define WIN32_LEAN_AND_MEAN
+ #define NOMINMAX
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <mach/mach.h>
+#else
+ #include <semaphore.h>
+#endif
+
+namespace
+{
+    // A counting semaphore whose post() is a single atomic or kernel call without a lock
+    class WakeSemaphore
+    {
+    public:
+       #if JUCE_WINDOWS
+        WakeSemaphore()   { handle = CreateSemaphore (nullptr, 0, 0x7fffffff, nullptr); }
+        ~WakeSemaphore()  { CloseHandle (handle); }
+        void post()       { ReleaseSemaphore (handle, 1, nullptr); }
+        void wait()       { WaitForSingleObject (handle, INFINITE); }
+       #elif JUCE_MAC || JUCE_IOS
+        WakeSemaphore()   { semaphore_create (mach_task_self(), &semaphore, SYNC_POLICY_FIFO, 0); }
+        ~WakeSemaphore()  { semaphore_destroy (mach_task_self(), semaphore); }
+        void post()       { semaphore_signal (semaphore); }
+        void wait()       { while (semaphore_wait (semaphore) == KERN_ABORTED) {} }
+       #else
+        WakeSemaphore()   { sem_init (&semaphore, 0, 0); }
+        ~WakeSemaphore()  { sem_destroy (&semaphore); }
+        void post()       { sem_post (&semaphore); }
+        void wait()       { while (sem_wait (&semaphore) != 0) {} }
+       #endif
+
+    private:
+       #if JUCE_WINDOWS
+        HANDLE handle;
+       #elif JUCE_MAC || JUCE_IOS
+        semaphore_t semaphore;
+       #else
+        sem_t semaphore;
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (WakeSemaphore)
+    };
+
+    // How many times a worker checks for the next block before going to sleep
+    const int numSpinsBeforeSleeping = 100;
+}
+
+class ChannelWorkerPool::Worker : public Thread
+{
+public:
+    Worker (ChannelWorkerPool& p) : Thread ("EQ channel worker"), pool (p) {}
+
+    void run() override
+    {
+        // the job functions run on this thread too, so flush denormals here as well
+        ScopedNoDenormals noDenormals;
+
+        uint32 seen = pool.generation.load (std::memory_order_acquire);
+
+        while (! threadShouldExit())
+        {
+            for (int i = 0; i < numSpinsBeforeSleeping && pool.generation.load (std::memory_order_acquire) == seen; i++)
+                Thread::yield();
+
+            if (pool.generation.load (std::memory_order_acquire) == seen)
+            {
+                // check again after saying we're asleep, run() bumps the generation before
+                // looking at the flag, so one of the two sees the other
+                asleep.store (true);
+                if (pool.generation.load() == seen && ! threadShouldExit())
+                    wakeUp.wait();
+
+                // if run() already took the flag it posted too, which leaves a spare wake-up
+                // for next time that just finds nothing to do
+                asleep.store (false);
+            }
+
+            seen = pool.generation.load (std::memory_order_acquire);
+            pool.runPendingItems();
+        }
+    }
+
+    // Posts to the semaphore if the worker is asleep, or about to be
+    void wake()
+    {
+        if (asleep.exchange (false))
+            wakeUp.post();
+    }
+
+    void wakeToExit()
+    {
+        signalThreadShouldExit();
+        wakeUp.post();
+    }
+
+private:
+    ChannelWorkerPool& pool;
+    WakeSemaphore wakeUp;
+    std::atomic<bool> asleep { false };
+};
+
+ChannelWorkerPool::ChannelWorkerPool(){}
+
+ChannelWorkerPool::~ChannelWorkerPool()
+{
+    setNumWorkers (0);
+}
+
+void ChannelWorkerPool::setNumWorkers (int numWorkers)
+{
+    while (workers.size() > numWorkers)
+    {
+        Worker* worker = workers.getLast();
+        worker->wakeToExit();
+        worker->stopThread (1000);
+        workers.removeLast();
+    }
+
+    // The audio thread spins on items a worker has claimed, so a worker preempted
+    // mid-item stalls the callback. They start at JUCE's realtime audio priority,
+    // like the host's audio thread, instead of just a high normal one.
+    while (workers.size() < numWorkers)
+        workers.add (new Worker (*this))->startThread (Thread::realtimeAudioPriority);
+}
+
+bool ChannelWorkerPool::runPendingItems()
+{
+    bool ranAny = false;
+
+    for (;;)
+    {
+        uint32 state = itemState.load (std::memory_order_acquire);
+        const int numItems = (int) (state >> 16);
+        const int item = (int) (state & 0xffff);
+
+        if (item >= numItems)
+            return ranAny;
+
+        if (! itemState.compare_exchange_weak (state, state + 1, std::memory_order_acq_rel))
+            continue;
+
+        currentJob (currentContext, item);
+        itemsRemaining.fetch_sub (1, std::memory_order_release);
+        ranAny = true;
+    }
+}
+
+void ChannelWorkerPool::run (JobFunction job, void* context, int numItems)
+{
+    jassert (numItems < 0x10000);
+
+    if (numItems <= 0)
+        return;
+
+    currentJob = job;
+    currentContext = context;
+    itemsRemaining.store (numItems, std::memory_order_relaxed);
+    itemState.store ((uint32) numItems << 16, std::memory_order_release);
+    generation.fetch_add (1);
+
+    // only wake as many workers as there are items for the others to take
+    const int numToWake = jmin (workers.size(), numItems - 1);
+    for (int i = 0; i < numToWake; i++)
+        workers.getUnchecked (i)->wake();
+
+    runPendingItems();
+
+    // whatever is left has been claimed by a worker and is already running
+    while (itemsRemaining.load (std::memory_order_acquire) > 0)
+        Thread::yield();
+}
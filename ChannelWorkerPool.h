@@ -0,0 +1,51 @@
+// This is the header for the worker pool that spreads channel groups
+// across cores. The audio thread hands out work through a single atomic
+// and takes part in the processing itself, so it never waits on a worker
+// that hasn't woken up yet and never takes a lock or allocates. It does
+// wait for items a worker has already started, so the workers run at
+// realtime audio priority. Workers watch a generation counter for a moment
+// after each block and then sleep on an OS semaphore, which the audio thread
+// only posts to if they're asleep. Posting one doesn't lock anything.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class ChannelWorkerPool
+{
+public:
+    typedef void (*JobFunction) (void* context, int item);
+
+    ChannelWorkerPool();
+    ~ChannelWorkerPool();
+
+    // Starts or stops threads so there are numWorkers of them. Not realtime safe.
+    void setNumWorkers (int numWorkers);
+    int getNumWorkers() const { return workers.size(); }
+
+    // Calls job (context, item) for every item in [0, numItems) on the workers and
+    // the calling thread, and returns once all of them have finished.
+    void run (JobFunction job, void* context, int numItems);
+
+private:
+    class Worker;
+
+    // Claims and runs items until none are left, returns false if there were none
+    bool runPendingItems();
+
+    OwnedArray<Worker> workers;
+
+    // Job of the current run(), only written while no items are outstanding
+    JobFunction currentJob = nullptr;
+    void* currentContext = nullptr;
+
+    // Number of items in the top 16 bits and the next unclaimed item in the bottom 16,
+    // so a worker can check and claim an item in one compare-and-swap
+    std::atomic<uint32> itemState { 0 };
+    std::atomic<int> itemsRemaining { 0 };
+
+    // Bumped by every run(), workers spin on it before going to sleep
+    std::atomic<uint32> generation { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ChannelWorkerPool)
+};
@@ -0,0 +1,144 @@
+// This header holds the original hand designed band kernels: 41 tap
+// low pass and band pass tables and a 33 tap high pass table, zero
+// padded to 41 taps. They are loaded until the first runtime design
+// for the host's sample rate is ready.
+
+#pragma once
+
+namespace ClassicKernels
+{
+    // P corresponds to low and band pass Coefficients
+    // P2 corresonds to high pass coefficients
+    const int P = 41;
+    const int P2 = 33;
+    
+    // Length of every table
+    const int length = P;
+    
+    const double lowPass[length] =
+    {
+        -0.0003919,
+        -0.0007032,
+        -0.001203,
+        -0.001776,
+        -0.002304,
+        -0.002603,
+        -0.002426,
+        -0.001483,
+        0.0005265,
+        0.003875,
+        0.008755,
+        0.01524,
+        0.02323,
+        0.03247,
+        0.04251,
+        0.05276,
+        0.06252,
+        0.07107,
+        0.07774,
+        0.08198,
+        0.08344,
+        0.08198,
+        0.07774,
+        0.07107,
+        0.06252,
+        0.05276,
+        0.04251,
+        0.03247,
+        0.02323,
+        0.01524,
+        0.008755,
+        0.003875,
+        0.0005265,
+        -0.001483,
+        -0.002426,
+        -0.002603,
+        -0.002304,
+        -0.001776,
+        -0.001203,
+        -0.0007032,
+        -0.0003919
+    };
+
+    const double bandPass[length] =
+    {
+        -4.652e-07,
+        -5.335e-06,
+        -3.298e-05,
+        -0.0001441,
+        -0.0004942,
+        -0.001407,
+        -0.003432,
+        -0.007326,
+        -0.01387,
+        -0.02345,
+        -0.03554,
+        -0.04819,
+        -0.05791,
+        -0.06022,
+        -0.05095,
+        -0.02796,
+        0.007339,
+        0.04948,
+        0.08984,
+        0.119,
+        0.1296,
+        0.119,
+        0.08984,
+        0.04948,
+        0.007339,
+        -0.02796,
+        -0.05095,
+        -0.06022,
+        -0.05791,
+        -0.04819,
+        -0.03554,
+        -0.02345,
+        -0.01387,
+        -0.007326,
+        -0.003432,
+        -0.001407,
+        -0.0004942,
+        -0.0001441,
+        -3.298e-05,
+        -5.335e-06,
+        -4.652e-07
+    };
+
+    const double hiPass[length] =
+    {
+        0.00363,
+        0.001044,
+        -0.001626,
+        -0.005666,
+        -0.008914,
+        -0.00845,
+        -0.002127,
+        0.009719,
+        0.02319,
+        0.03131,
+        0.02627,
+        0.00259,
+        -0.03974,
+        -0.09402,
+        -0.1481,
+        -0.188,
+        0.7973,
+        -0.188,
+        -0.1481,
+        -0.09402,
+        -0.03974,
+        0.00259,
+        0.02627,
+        0.03131,
+        0.02319,
+        0.009719,
+        -0.002127,
+        -0.00845,
+        -0.008914,
+        -0.005666,
+        -0.001626,
+        0.001044,
+        0.00363
+    };
+}
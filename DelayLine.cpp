@@ -0,0 +1,63 @@
+// This file contains the mirrored circular delay line that holds the FIR input history.
+
+#include "DelayLine.h"
+
+template <typename FloatType>
+DelayLine<FloatType>::DelayLine() {}
+
+template <typename FloatType>
+DelayLine<FloatType>::~DelayLine() {}
+
+template <typename FloatType>
+void DelayLine<FloatType>::prepare (int numChannels, int newMaxHistory, int maxBlockSize)
+{
+    maxHistory = newMaxHistory;
+    length = maxHistory + maxBlockSize;
+
+    buffer.setSize (numChannels, 2 * length);
+    writePositions.calloc ((size_t) numChannels);
+    clear();
+}
+
+template <typename FloatType>
+void DelayLine<FloatType>::clear()
+{
+    buffer.clear();
+}
+
+template <typename FloatType>
+void DelayLine<FloatType>::clearChannel (int chan)
+{
+    buffer.clear (chan, 0, buffer.getNumSamples());
+}
+
+template <typename FloatType>
+const FloatType* DelayLine<FloatType>::write (int chan, const FloatType* input, int numSamples)
+{
+    jassert (numSamples <= length - maxHistory);
+
+    FloatType* ring = buffer.getWritePointer (chan);
+    int& position = writePositions[chan];
+
+    // the block goes into both halves, in two pieces when it wraps round the end
+    const int firstPart = jmin (numSamples, length - position);
+    FloatVectorOperations::copy (ring + position, input, firstPart);
+    FloatVectorOperations::copy (ring + length + position, input, firstPart);
+    FloatVectorOperations::copy (ring, input + firstPart, numSamples - firstPart);
+    FloatVectorOperations::copy (ring + length, input + firstPart, numSamples - firstPart);
+
+    // Starting the window in the first half means it never runs off the end of the
+    // second, and the second half repeats the first, so the window reads straight through
+    int start = position - maxHistory;
+    if (start < 0)
+        start += length;
+
+    position += numSamples;
+    if (position >= length)
+        position -= length;
+
+    return ring + start + maxHistory;
+}
+
+template class DelayLine<float>;
+template class DelayLine<double>;
@@ -0,0 +1,40 @@
+// This is the header for the per channel input history of the FIR kernels.
+// Each channel has a circular buffer that is written twice, once in each
+// half of a block twice its length. Any window of up to its length that
+// ends at the newest sample is then contiguous in memory, so the kernels
+// see history and new block as one array without an end of block copy,
+// whatever the block sizes the host sends.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+template <typename FloatType>
+class DelayLine
+{
+public:
+    DelayLine();
+    ~DelayLine();
+
+    // Allocates room for maxHistory samples of history behind blocks of up to
+    // maxBlockSize samples, and clears it. Not realtime safe.
+    void prepare (int numChannels, int maxHistory, int maxBlockSize);
+
+    // Fills the history of every channel, or of one, with silence
+    void clear();
+    void clearChannel (int chan);
+
+    // Appends numSamples of input to a channel and returns where they now are. The
+    // maxHistory samples before the returned pointer are the channel's earlier input,
+    // and all of it stays valid until the channel is written again.
+    const FloatType* write (int chan, const FloatType* input, int numSamples);
+
+private:
+    // each channel's ring is `length` samples, stored twice
+    AudioBuffer<FloatType> buffer;
+    HeapBlock<int> writePositions;
+    int length = 0;
+    int maxHistory = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DelayLine)
+};
@@ -0,0 +1,432 @@
+// This file contains the uniformly partitioned overlap-save convolution engine.
+// Each channel keeps a frequency domain delay line of its last numPartitions
+// input spectra. Once a partition of input has arrived it is transformed,
+// pushed into the delay line, multiplied with the matching kernel partition
+// spectra, and one inverse FFT gives the next partition of output.
+// The double precision FFT packs the real signal into a complex one of half
+// the size, with the even samples as real parts and the odd ones as imaginary.
+
+#include "FFTConvolver.h"
+
+template <>
+RealFFT<float>::RealFFT (int order)
+    : size (1 << order), fft (new dsp::FFT (order))
+{
+}
+
+template <>
+RealFFT<double>::RealFFT (int order)
+    : size (1 << order)
+{
+    const int half = size / 2;
+    bitReversed.malloc ((size_t) half);
+    butterflyTwiddles.malloc ((size_t) half);
+    splitTwiddles.malloc ((size_t) (half + 2));
+
+    for (int i = 0, j = 0; i < half; i++)
+    {
+        bitReversed[i] = j;
+
+        int bit = half >> 1;
+        for (; (j & bit) != 0; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+    }
+
+    for (int k = 0; k < half / 2; k++)
+    {
+        const double angle = -MathConstants<double>::twoPi * k / half;
+        butterflyTwiddles[2 * k] = std::cos (angle);
+        butterflyTwiddles[2 * k + 1] = std::sin (angle);
+    }
+
+    for (int k = 0; k <= half / 2; k++)
+    {
+        const double angle = -MathConstants<double>::twoPi * k / size;
+        splitTwiddles[2 * k] = std::cos (angle);
+        splitTwiddles[2 * k + 1] = std::sin (angle);
+    }
+}
+
+template <>
+void RealFFT<float>::performRealOnlyForwardTransform (float* data) const
+{
+    fft->performRealOnlyForwardTransform (data, true);
+}
+
+template <>
+void RealFFT<float>::performRealOnlyInverseTransform (float* data) const
+{
+    fft->performRealOnlyInverseTransform (data);
+}
+
+template <>
+void RealFFT<double>::performRealOnlyForwardTransform (double* data) const
+{
+    performComplexTransform (data, false);
+    const int half = size / 2;
+
+    // bins 0 and size/2 are the sum and difference of the even and odd parts at DC
+    const double dcReal = data[0];
+    const double dcImag = data[1];
+    data[0] = dcReal + dcImag;
+    data[1] = 0.0;
+    data[2 * half] = dcReal - dcImag;
+    data[2 * half + 1] = 0.0;
+
+    // Z[k] and Z[half - k] give the spectra of the even samples E and odd samples O
+    // at both bins, and X[k] = E[k] + e^(-2 pi i k/size) O[k]
+    for (int k = 1; k <= half / 2; k++)
+    {
+        const int m = half - k;
+        const double ar = data[2 * k], ai = data[2 * k + 1];
+        const double br = data[2 * m], bi = data[2 * m + 1];
+
+        const double evenReal = 0.5 * (ar + br), evenImag = 0.5 * (ai - bi);
+        const double oddReal = 0.5 * (ai + bi), oddImag = -0.5 * (ar - br);
+        const double wr = splitTwiddles[2 * k], wi = splitTwiddles[2 * k + 1];
+        const double twiddledReal = wr * oddReal - wi * oddImag;
+        const double twiddledImag = wr * oddImag + wi * oddReal;
+
+        // E[m] and O[m] are the conjugates of E[k] and O[k], and the twiddle is -conj
+        data[2 * k] = evenReal + twiddledReal;
+        data[2 * k + 1] = evenImag + twiddledImag;
+        data[2 * m] = evenReal - twiddledReal;
+        data[2 * m + 1] = twiddledImag - evenImag;
+    }
+}
+
+template <>
+void RealFFT<double>::performRealOnlyInverseTransform (double* data) const
+{
+    const int half = size / 2;
+
+    // the forward split backwards, E[k] + i O[k] puts the even and odd samples back together
+    const double first = data[0];
+    const double last = data[2 * half];
+    data[0] = 0.5 * (first + last);
+    data[1] = 0.5 * (first - last);
+
+    for (int k = 1; k <= half / 2; k++)
+    {
+        const int m = half - k;
+        const double ar = data[2 * k], ai = data[2 * k + 1];
+        const double br = data[2 * m], bi = data[2 * m + 1];
+
+        const double evenReal = 0.5 * (ar + br), evenImag = 0.5 * (ai - bi);
+        const double dr = ar - br, di = ai + bi;
+        const double wr = splitTwiddles[2 * k], wi = splitTwiddles[2 * k + 1];
+        const double oddReal = 0.5 * (dr * wr + di * wi);
+        const double oddImag = 0.5 * (di * wr - dr * wi);
+
+        data[2 * k] = evenReal - oddImag;
+        data[2 * k + 1] = evenImag + oddReal;
+        data[2 * m] = evenReal + oddImag;
+        data[2 * m + 1] = oddReal - evenImag;
+    }
+
+    performComplexTransform (data, true);
+
+    const double scale = 1.0 / half;
+    for (int i = 0; i < size; i++)
+        data[i] *= scale;
+}
+
+template <typename FloatType>
+void RealFFT<FloatType>::performComplexTransform (FloatType* data, bool inverse) const
+{
+    const int half = size / 2;
+
+    for (int i = 0; i < half; i++)
+    {
+        const int j = bitReversed[i];
+        if (i < j)
+        {
+            std::swap (data[2 * i], data[2 * j]);
+            std::swap (data[2 * i + 1], data[2 * j + 1]);
+        }
+    }
+
+    // radix-2 butterflies, the inverse takes the conjugate twiddles
+    const FloatType sign = inverse ? (FloatType) -1 : (FloatType) 1;
+
+    for (int length = 2; length <= half; length *= 2)
+    {
+        const int step = half / length;
+
+        for (int start = 0; start < half; start += length)
+        {
+            for (int j = 0; j < length / 2; j++)
+            {
+                const FloatType wr = (FloatType) butterflyTwiddles[2 * j * step];
+                const FloatType wi = sign * (FloatType) butterflyTwiddles[2 * j * step + 1];
+                FloatType* a = data + 2 * (start + j);
+                FloatType* b = a + length;
+
+                const FloatType br = b[0] * wr - b[1] * wi;
+                const FloatType bi = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - br;
+                b[1] = a[1] - bi;
+                a[0] += br;
+                a[1] += bi;
+            }
+        }
+    }
+}
+
+template class RealFFT<float>;
+template class RealFFT<double>;
+
+//==============================================================================
+template <typename FloatType>
+FFTConvolver<FloatType>::FFTConvolver(){}
+
+template <typename FloatType>
+FFTConvolver<FloatType>::~FFTConvolver(){}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::prepare (int newNumChannels, int newPartitionSize, int maxKernelLength, int numKernelSlots)
+{
+    jassert (isPowerOfTwo (newPartitionSize));
+
+    numChannels = newNumChannels;
+    partitionSize = newPartitionSize;
+    fftSize = 2 * partitionSize;
+    numPartitions = getNumPartitions (maxKernelLength, partitionSize);
+    numSlots = numKernelSlots;
+    spectrumSize = getSpectrumSize (partitionSize);
+
+    int order = 0;
+    while ((1 << order) < fftSize)
+        order++;
+
+    fft.reset (new RealFFT<FloatType> (order));
+
+    kernelSpectra.calloc ((size_t) (numSlots * numPartitions * spectrumSize));
+    slotPartitions.calloc ((size_t) numSlots);
+    delayLines.calloc ((size_t) (numChannels * numPartitions * spectrumSize));
+    inputWindows.calloc ((size_t) (numChannels * fftSize));
+    outputBlocks.calloc ((size_t) (numChannels * partitionSize));
+    delayLinePositions.calloc ((size_t) numChannels);
+    inputPositions.calloc ((size_t) numChannels);
+    switchPending.calloc ((size_t) numChannels);
+    channelCleared.calloc ((size_t) numChannels);
+    fftBuffers.calloc ((size_t) (numChannels * 2 * fftSize));
+    previousBuffers.calloc ((size_t) (numChannels * 2 * fftSize));
+
+    currentSlot = 0;
+    previousSlot = 0;
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::reset()
+{
+    FloatVectorOperations::clear (delayLines.getData(), numChannels * numPartitions * spectrumSize);
+    FloatVectorOperations::clear (inputWindows.getData(), numChannels * fftSize);
+    FloatVectorOperations::clear (outputBlocks.getData(), numChannels * partitionSize);
+
+    for (int chan = 0; chan < numChannels; chan++)
+    {
+        delayLinePositions[chan] = 0;
+        inputPositions[chan] = 0;
+        switchPending[chan] = false;
+        channelCleared[chan] = true;
+    }
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::resetChannel (int channel)
+{
+    switchPending[channel] = false;
+
+    if (channelCleared[channel])
+        return;
+
+    FloatVectorOperations::clear (getDelayLineSpectrum (channel, 0), numPartitions * spectrumSize);
+    FloatVectorOperations::clear (inputWindows + channel * fftSize, fftSize);
+    FloatVectorOperations::clear (outputBlocks + channel * partitionSize, partitionSize);
+
+    delayLinePositions[channel] = 0;
+    inputPositions[channel] = 0;
+    channelCleared[channel] = true;
+}
+
+template <typename FloatType>
+FloatType* FFTConvolver<FloatType>::getKernelSpectrum (int slot, int partition) const
+{
+    return kernelSpectra + (slot * numPartitions + partition) * spectrumSize;
+}
+
+template <typename FloatType>
+FloatType* FFTConvolver<FloatType>::getDelayLineSpectrum (int channel, int partition) const
+{
+    return delayLines + (channel * numPartitions + partition) * spectrumSize;
+}
+
+template <typename FloatType>
+int FFTConvolver<FloatType>::getNumPartitions (int kernelLength, int partitionSize)
+{
+    return jmax (1, (kernelLength + partitionSize - 1) / partitionSize);
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::transformKernel (const RealFFT<FloatType>& kernelFFT, int kernelPartitionSize, const float* kernel,
+                                               int length, FloatType* spectra, FloatType* workSpace)
+{
+    const int kernelFFTSize = 2 * kernelPartitionSize;
+    const int kernelSpectrumSize = getSpectrumSize (kernelPartitionSize);
+    const int kernelPartitions = getNumPartitions (length, kernelPartitionSize);
+
+    for (int p = 0; p < kernelPartitions; p++)
+    {
+        // overlap-save: each kernel partition goes in the first half of a zero padded frame
+        const int start = p * kernelPartitionSize;
+        const int count = jmin (kernelPartitionSize, length - start);
+
+        FloatVectorOperations::clear (workSpace, 2 * kernelFFTSize);
+        for (int i = 0; i < count; i++)
+            workSpace[i] = (FloatType) kernel[start + i];
+
+        kernelFFT.performRealOnlyForwardTransform (workSpace);
+        FloatVectorOperations::copy (spectra + p * kernelSpectrumSize, workSpace, kernelSpectrumSize);
+    }
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::mixKernels (int destSlot, const FloatType* const* sourceSpectra, const float* gains,
+                                          int numSources, int numKernelPartitions)
+{
+    jassert (numKernelPartitions <= numPartitions);
+
+    const int size = numKernelPartitions * spectrumSize;
+    FloatType* dest = getKernelSpectrum (destSlot, 0);
+
+    FloatVectorOperations::copyWithMultiply (dest, sourceSpectra[0], (FloatType) gains[0], size);
+
+    for (int i = 1; i < numSources; i++)
+        FloatVectorOperations::addWithMultiply (dest, sourceSpectra[i], (FloatType) gains[i], size);
+
+    slotPartitions[destSlot] = numKernelPartitions;
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::switchKernel (int slot, bool crossfade)
+{
+    jassert (! crossfade || ! isSwitchingKernel());
+
+    previousSlot = currentSlot;
+    currentSlot = slot;
+
+    for (int chan = 0; chan < numChannels; chan++)
+        switchPending[chan] = crossfade;
+}
+
+template <typename FloatType>
+bool FFTConvolver<FloatType>::isSwitchingKernel() const
+{
+    for (int chan = 0; chan < numChannels; chan++)
+        if (switchPending[chan])
+            return true;
+
+    return false;
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::multiplyAccumulate (int channel, int slot, FloatType* result)
+{
+    FloatVectorOperations::clear (result, spectrumSize);
+
+    // delay line partition d holds the input from d partitions ago,
+    // which meets kernel partition d
+    int position = delayLinePositions[channel];
+
+    for (int p = 0; p < slotPartitions[slot]; p++)
+    {
+        const FloatType* x = getDelayLineSpectrum (channel, position);
+        const FloatType* h = getKernelSpectrum (slot, p);
+
+        for (int bin = 0; bin < spectrumSize; bin += 2)
+        {
+            result[bin]     += x[bin] * h[bin]     - x[bin + 1] * h[bin + 1];
+            result[bin + 1] += x[bin] * h[bin + 1] + x[bin + 1] * h[bin];
+        }
+
+        if (--position < 0)
+            position = numPartitions - 1;
+    }
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::processPartition (int channel)
+{
+    FloatType* window = inputWindows + channel * fftSize;
+    FloatType* output = outputBlocks + channel * partitionSize;
+    FloatType* fftBuffer = fftBuffers + channel * 2 * fftSize;
+    FloatType* previousBuffer = previousBuffers + channel * 2 * fftSize;
+
+    // transform the last two partitions of input and push the result into the delay line
+    int position = delayLinePositions[channel] + 1;
+    if (position == numPartitions)
+        position = 0;
+    delayLinePositions[channel] = position;
+
+    FloatVectorOperations::copy (fftBuffer, window, fftSize);
+    fft->performRealOnlyForwardTransform (fftBuffer);
+    FloatVectorOperations::copy (getDelayLineSpectrum (channel, position), fftBuffer, spectrumSize);
+
+    // convolve with the active kernel, only the second half of the frame is alias free
+    multiplyAccumulate (channel, currentSlot, fftBuffer);
+    fft->performRealOnlyInverseTransform (fftBuffer);
+    FloatVectorOperations::copy (output, fftBuffer + partitionSize, partitionSize);
+
+    // crossfade from the previous kernel over this partition after a switch
+    if (switchPending[channel])
+    {
+        multiplyAccumulate (channel, previousSlot, previousBuffer);
+        fft->performRealOnlyInverseTransform (previousBuffer);
+        const FloatType* previous = previousBuffer + partitionSize;
+
+        for (int i = 0; i < partitionSize; i++)
+        {
+            const FloatType fade = (FloatType) (i + 1) / partitionSize;
+            output[i] = previous[i] + fade * (output[i] - previous[i]);
+        }
+
+        switchPending[channel] = false;
+    }
+
+    // the newest partition becomes the older half of the next frame
+    FloatVectorOperations::copy (window, window + partitionSize, partitionSize);
+}
+
+template <typename FloatType>
+void FFTConvolver<FloatType>::process (int channel, const FloatType* input, FloatType* output, int numSamples)
+{
+    FloatType* window = inputWindows + channel * fftSize;
+    const FloatType* pending = outputBlocks + channel * partitionSize;
+    channelCleared[channel] = false;
+
+    while (numSamples > 0)
+    {
+        const int position = inputPositions[channel];
+        const int count = jmin (numSamples, partitionSize - position);
+
+        // read the input before writing the output, they may be the same buffer
+        FloatVectorOperations::copy (window + partitionSize + position, input, count);
+        FloatVectorOperations::copy (output, pending + position, count);
+
+        inputPositions[channel] = position + count;
+        input += count;
+        output += count;
+        numSamples -= count;
+
+        if (inputPositions[channel] == partitionSize)
+        {
+            processPartition (channel);
+            inputPositions[channel] = 0;
+        }
+    }
+}
+
+template class FFTConvolver<float>;
+template class FFTConvolver<double>;
@@ -0,0 +1,133 @@
+// This is the header for the uniformly partitioned FFT convolution engine.
+// Long kernels are cut into partitions of the host block size, and each
+// partition is convolved in the frequency domain by overlap-save, so the
+// cost per sample grows with log of the partition size instead of with
+// the kernel length. The price is one partition of extra latency.
+// It runs in either precision, double precision hosts get their own FFT.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// Real only FFT with the data layout of dsp::FFT: size samples in, then size/2 + 1
+// interleaved complex bins out, in a buffer of 2*size values. The inverse scales by
+// 1/size. Floats go through dsp::FFT, which only does floats, so doubles get a radix-2
+// transform of half the size here, split into the real spectrum afterwards.
+template <typename FloatType>
+class RealFFT
+{
+public:
+    explicit RealFFT (int order);
+
+    int getSize() const { return size; }
+
+    void performRealOnlyForwardTransform (FloatType* data) const;
+    void performRealOnlyInverseTransform (FloatType* data) const;
+
+private:
+    // Complex FFT of size/2 points on interleaved data, in place
+    void performComplexTransform (FloatType* data, bool inverse) const;
+
+    int size;
+    std::unique_ptr<dsp::FFT> fft;
+
+    // for the double transform: bit reversed order, e^(-2 pi i k/(size/2)) for the
+    // butterflies and e^(-2 pi i k/size) for the split, all interleaved
+    HeapBlock<int> bitReversed;
+    HeapBlock<double> butterflyTwiddles;
+    HeapBlock<double> splitTwiddles;
+
+    JUCE_DECLARE_NON_COPYABLE (RealFFT)
+};
+
+template <typename FloatType>
+class FFTConvolver
+{
+public:
+    FFTConvolver();
+    ~FFTConvolver();
+
+    // Allocates everything for the given channel count, partition size (a power of two),
+    // maximum kernel length and number of kernel slots. Not realtime safe.
+    void prepare (int numChannels, int partitionSize, int maxKernelLength, int numKernelSlots);
+
+    // Clears the input history and pending output of every channel
+    void reset();
+
+    // Clears one channel like reset() and drops its pending kernel switch, so a channel
+    // that is not being processed doesn't hold up isSwitchingKernel(). This is cheap
+    // when nothing has been processed on the channel since it was last cleared.
+    void resetChannel (int channel);
+
+    // Number of partitions and values per partition spectrum for a kernel
+    static int getNumPartitions (int kernelLength, int partitionSize);
+    static int getSpectrumSize (int partitionSize) { return 2 * partitionSize + 2; }
+
+    // Transforms a time domain kernel into numPartitions partition spectra. This runs
+    // on whatever thread designs the kernel, using its own FFT of order log2(2*partitionSize)
+    // and a work space of 4*partitionSize values.
+    static void transformKernel (const RealFFT<FloatType>& fft, int partitionSize, const float* kernel,
+                                 int length, FloatType* spectra, FloatType* workSpace);
+
+    // Sets destSlot to the gain weighted sum of partitioned kernel spectra made by
+    // transformKernel. Convolution is linear, so this needs no FFTs and is cheap
+    // enough to run on the audio thread.
+    void mixKernels (int destSlot, const FloatType* const* sourceSpectra, const float* gains,
+                     int numSources, int numKernelPartitions);
+
+    // Makes slot the active kernel. Unless crossfade is false, each channel
+    // crossfades from the previous kernel over the next partition it outputs.
+    void switchKernel (int slot, bool crossfade = true);
+
+    // True until every channel has finished crossfading to the last switched kernel
+    bool isSwitchingKernel() const;
+
+    // Convolves numSamples of one channel. output may alias input.
+    // Different channels may be processed on different threads at the same time.
+    void process (int channel, const FloatType* input, FloatType* output, int numSamples);
+
+    int getPartitionSize() const { return partitionSize; }
+    int getLatencySamples() const { return partitionSize; }
+
+private:
+    // Runs the frequency domain convolution once a full partition of input has arrived
+    void processPartition (int channel);
+
+    // Multiplies the frequency domain delay line of a channel with a kernel slot
+    void multiplyAccumulate (int channel, int slot, FloatType* result);
+
+    FloatType* getKernelSpectrum (int slot, int partition) const;
+    FloatType* getDelayLineSpectrum (int channel, int partition) const;
+
+    std::unique_ptr<RealFFT<FloatType>> fft;
+
+    int numChannels = 0;
+    int partitionSize = 0;
+    int fftSize = 0;
+    int numPartitions = 0;
+    int numSlots = 0;
+
+    // values per stored spectrum: fftSize/2+1 interleaved complex bins
+    int spectrumSize = 0;
+
+    int currentSlot = 0;
+    int previousSlot = 0;
+
+    // partitions actually used by the kernel in each slot
+    HeapBlock<int> slotPartitions;
+
+    HeapBlock<FloatType> kernelSpectra;    // numSlots x numPartitions spectra
+    HeapBlock<FloatType> delayLines;       // numChannels x numPartitions input spectra
+    HeapBlock<FloatType> inputWindows;     // numChannels x fftSize, last two partitions of input
+    HeapBlock<FloatType> outputBlocks;     // numChannels x partitionSize, output waiting to be read
+    HeapBlock<int> delayLinePositions;     // newest spectrum in each channel's delay line
+    HeapBlock<int> inputPositions;         // samples received in the current partition
+    HeapBlock<bool> switchPending;         // channels that still have to crossfade
+    HeapBlock<bool> channelCleared;        // channels with nothing processed since they were cleared
+
+    // FFT work space, 2*fftSize values per channel so channels can run in parallel
+    HeapBlock<FloatType> fftBuffers;
+    HeapBlock<FloatType> previousBuffers;
+
+    JUCE_DECLARE_NON_COPYABLE (FFTConvolver)
+};
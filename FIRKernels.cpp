@@ -0,0 +1,545 @@
+// This file contains the FIR convolution kernels used by the EQ.
+// The SIMD versions vectorise across output samples rather than taps:
+// each coefficient is broadcast into a register and multiplied with
+// several neighbouring input samples at once, which keeps the loop
+// free of horizontal sums and works for any number of taps.
+// Symmetric kernels fold each pair of mirrored taps into one.
+
+#include "FIRKernels.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+
+ // GCC and Clang need to be told they can use AVX2 in this one function,
+ // the rest of the plug-in is still built for the baseline instruction set.
+ #if JUCE_MSVC
+  #define FIR_TARGET_AVX2
+ #else
+  #define FIR_TARGET_AVX2 __attribute__ ((target ("avx2,fma")))
+ #endif
+#endif
+
+namespace FIRKernels
+{
+
+template <typename FloatType>
+void processScalar (const FloatType* input, FloatType* output, int numSamples,
+                    const FloatType* coeffs, int numTaps)
+{
+    for (int n = 0; n < numSamples; n++)
+    {
+        const FloatType* x = input + n;
+        FloatType sum = 0;
+
+        for (int k = 0; k < numTaps; k++)
+            sum += coeffs[k] * x[-k];
+
+        output[n] = sum;
+    }
+}
+
+template void processScalar (const float*, float*, int, const float*, int);
+template void processScalar (const double*, double*, int, const double*, int);
+
+// Symmetric kernels, see getSymmetricProcessFunction. NumTaps is the tap count,
+// or 0 for the version that takes it at runtime.
+template <typename FloatType, int NumTaps>
+void processSymmetricScalar (const FloatType* input, FloatType* output, int numSamples,
+                             const FloatType* coeffs, int numTaps)
+{
+    // a constant for the compiled tap counts, so the tap loop can be fully unrolled
+    const int taps = NumTaps > 0 ? NumTaps : numTaps;
+    const int half = taps / 2;
+    jassert (NumTaps == 0 || numTaps == NumTaps);
+
+    for (int n = 0; n < numSamples; n++)
+    {
+        const FloatType* x = input + n;
+        const FloatType* xMirror = x - (taps - 1);
+
+        // the centre tap is the only one without a partner
+        FloatType sum = coeffs[half] * x[-half];
+
+        for (int k = 0; k < half; k++)
+            sum += coeffs[k] * (x[-k] + xMirror[k]);
+
+        output[n] = sum;
+    }
+}
+
+#if JUCE_INTEL
+void processSSE (const float* input, float* output, int numSamples,
+                 const float* coeffs, int numTaps)
+{
+    int n = 0;
+
+    // 16 outputs per iteration, with 4 independent accumulators
+    for (; n + 16 <= numSamples; n += 16)
+    {
+        const float* x = input + n;
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        __m128 acc2 = _mm_setzero_ps();
+        __m128 acc3 = _mm_setzero_ps();
+
+        for (int k = 0; k < numTaps; k++)
+        {
+            const __m128 c = _mm_set1_ps (coeffs[k]);
+            const float* xk = x - k;
+            acc0 = _mm_add_ps (acc0, _mm_mul_ps (c, _mm_loadu_ps (xk)));
+            acc1 = _mm_add_ps (acc1, _mm_mul_ps (c, _mm_loadu_ps (xk + 4)));
+            acc2 = _mm_add_ps (acc2, _mm_mul_ps (c, _mm_loadu_ps (xk + 8)));
+            acc3 = _mm_add_ps (acc3, _mm_mul_ps (c, _mm_loadu_ps (xk + 12)));
+        }
+
+        _mm_storeu_ps (output + n,      acc0);
+        _mm_storeu_ps (output + n + 4,  acc1);
+        _mm_storeu_ps (output + n + 8,  acc2);
+        _mm_storeu_ps (output + n + 12, acc3);
+    }
+
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const float* x = input + n;
+        __m128 acc = _mm_setzero_ps();
+
+        for (int k = 0; k < numTaps; k++)
+            acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (coeffs[k]), _mm_loadu_ps (x - k)));
+
+        _mm_storeu_ps (output + n, acc);
+    }
+
+    processScalar (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+void processSSE (const double* input, double* output, int numSamples,
+                 const double* coeffs, int numTaps)
+{
+    int n = 0;
+
+    // 8 outputs per iteration, with 4 independent accumulators
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        const double* x = input + n;
+        __m128d acc0 = _mm_setzero_pd();
+        __m128d acc1 = _mm_setzero_pd();
+        __m128d acc2 = _mm_setzero_pd();
+        __m128d acc3 = _mm_setzero_pd();
+
+        for (int k = 0; k < numTaps; k++)
+        {
+            const __m128d c = _mm_set1_pd (coeffs[k]);
+            const double* xk = x - k;
+            acc0 = _mm_add_pd (acc0, _mm_mul_pd (c, _mm_loadu_pd (xk)));
+            acc1 = _mm_add_pd (acc1, _mm_mul_pd (c, _mm_loadu_pd (xk + 2)));
+            acc2 = _mm_add_pd (acc2, _mm_mul_pd (c, _mm_loadu_pd (xk + 4)));
+            acc3 = _mm_add_pd (acc3, _mm_mul_pd (c, _mm_loadu_pd (xk + 6)));
+        }
+
+        _mm_storeu_pd (output + n,     acc0);
+        _mm_storeu_pd (output + n + 2, acc1);
+        _mm_storeu_pd (output + n + 4, acc2);
+        _mm_storeu_pd (output + n + 6, acc3);
+    }
+
+    for (; n + 2 <= numSamples; n += 2)
+    {
+        const double* x = input + n;
+        __m128d acc = _mm_setzero_pd();
+
+        for (int k = 0; k < numTaps; k++)
+            acc = _mm_add_pd (acc, _mm_mul_pd (_mm_set1_pd (coeffs[k]), _mm_loadu_pd (x - k)));
+
+        _mm_storeu_pd (output + n, acc);
+    }
+
+    processScalar (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+FIR_TARGET_AVX2 void processAVX2 (const float* input, float* output, int numSamples,
+                                  const float* coeffs, int numTaps)
+{
+    int n = 0;
+
+    // 32 outputs per iteration, with 4 independent accumulators to hide the FMA latency
+    for (; n + 32 <= numSamples; n += 32)
+    {
+        const float* x = input + n;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+
+        for (int k = 0; k < numTaps; k++)
+        {
+            const __m256 c = _mm256_broadcast_ss (coeffs + k);
+            const float* xk = x - k;
+            acc0 = _mm256_fmadd_ps (c, _mm256_loadu_ps (xk),      acc0);
+            acc1 = _mm256_fmadd_ps (c, _mm256_loadu_ps (xk + 8),  acc1);
+            acc2 = _mm256_fmadd_ps (c, _mm256_loadu_ps (xk + 16), acc2);
+            acc3 = _mm256_fmadd_ps (c, _mm256_loadu_ps (xk + 24), acc3);
+        }
+
+        _mm256_storeu_ps (output + n,      acc0);
+        _mm256_storeu_ps (output + n + 8,  acc1);
+        _mm256_storeu_ps (output + n + 16, acc2);
+        _mm256_storeu_ps (output + n + 24, acc3);
+    }
+
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        const float* x = input + n;
+        __m256 acc = _mm256_setzero_ps();
+
+        for (int k = 0; k < numTaps; k++)
+            acc = _mm256_fmadd_ps (_mm256_broadcast_ss (coeffs + k), _mm256_loadu_ps (x - k), acc);
+
+        _mm256_storeu_ps (output + n, acc);
+    }
+
+    processScalar (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+FIR_TARGET_AVX2 void processAVX2 (const double* input, double* output, int numSamples,
+                                  const double* coeffs, int numTaps)
+{
+    int n = 0;
+
+    // 16 outputs per iteration, with 4 independent accumulators to hide the FMA latency
+    for (; n + 16 <= numSamples; n += 16)
+    {
+        const double* x = input + n;
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd();
+        __m256d acc3 = _mm256_setzero_pd();
+
+        for (int k = 0; k < numTaps; k++)
+        {
+            const __m256d c = _mm256_broadcast_sd (coeffs + k);
+            const double* xk = x - k;
+            acc0 = _mm256_fmadd_pd (c, _mm256_loadu_pd (xk),      acc0);
+            acc1 = _mm256_fmadd_pd (c, _mm256_loadu_pd (xk + 4),  acc1);
+            acc2 = _mm256_fmadd_pd (c, _mm256_loadu_pd (xk + 8),  acc2);
+            acc3 = _mm256_fmadd_pd (c, _mm256_loadu_pd (xk + 12), acc3);
+        }
+
+        _mm256_storeu_pd (output + n,      acc0);
+        _mm256_storeu_pd (output + n + 4,  acc1);
+        _mm256_storeu_pd (output + n + 8,  acc2);
+        _mm256_storeu_pd (output + n + 12, acc3);
+    }
+
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const double* x = input + n;
+        __m256d acc = _mm256_setzero_pd();
+
+        for (int k = 0; k < numTaps; k++)
+            acc = _mm256_fmadd_pd (_mm256_broadcast_sd (coeffs + k), _mm256_loadu_pd (x - k), acc);
+
+        _mm256_storeu_pd (output + n, acc);
+    }
+
+    processScalar (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+template <int NumTaps>
+void processSymmetricSSE (const float* input, float* output, int numSamples,
+                          const float* coeffs, int numTaps)
+{
+    const int taps = NumTaps > 0 ? NumTaps : numTaps;
+    const int half = taps / 2;
+    jassert (NumTaps == 0 || numTaps == NumTaps);
+    int n = 0;
+
+    // 16 outputs per iteration, each coefficient multiplies the sum of its two mirrored inputs
+    for (; n + 16 <= numSamples; n += 16)
+    {
+        const float* x = input + n;
+        const float* xMirror = x - (taps - 1);
+
+        const __m128 centre = _mm_set1_ps (coeffs[half]);
+        __m128 acc0 = _mm_mul_ps (centre, _mm_loadu_ps (x - half));
+        __m128 acc1 = _mm_mul_ps (centre, _mm_loadu_ps (x - half + 4));
+        __m128 acc2 = _mm_mul_ps (centre, _mm_loadu_ps (x - half + 8));
+        __m128 acc3 = _mm_mul_ps (centre, _mm_loadu_ps (x - half + 12));
+
+        for (int k = 0; k < half; k++)
+        {
+            const __m128 c = _mm_set1_ps (coeffs[k]);
+            const float* xk = x - k;
+            const float* xm = xMirror + k;
+            acc0 = _mm_add_ps (acc0, _mm_mul_ps (c, _mm_add_ps (_mm_loadu_ps (xk),      _mm_loadu_ps (xm))));
+            acc1 = _mm_add_ps (acc1, _mm_mul_ps (c, _mm_add_ps (_mm_loadu_ps (xk + 4),  _mm_loadu_ps (xm + 4))));
+            acc2 = _mm_add_ps (acc2, _mm_mul_ps (c, _mm_add_ps (_mm_loadu_ps (xk + 8),  _mm_loadu_ps (xm + 8))));
+            acc3 = _mm_add_ps (acc3, _mm_mul_ps (c, _mm_add_ps (_mm_loadu_ps (xk + 12), _mm_loadu_ps (xm + 12))));
+        }
+
+        _mm_storeu_ps (output + n,      acc0);
+        _mm_storeu_ps (output + n + 4,  acc1);
+        _mm_storeu_ps (output + n + 8,  acc2);
+        _mm_storeu_ps (output + n + 12, acc3);
+    }
+
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const float* x = input + n;
+        const float* xMirror = x - (taps - 1);
+        __m128 acc = _mm_mul_ps (_mm_set1_ps (coeffs[half]), _mm_loadu_ps (x - half));
+
+        for (int k = 0; k < half; k++)
+            acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (coeffs[k]), _mm_add_ps (_mm_loadu_ps (x - k), _mm_loadu_ps (xMirror + k))));
+
+        _mm_storeu_ps (output + n, acc);
+    }
+
+    processSymmetricScalar<float, NumTaps> (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+template <int NumTaps>
+void processSymmetricSSE (const double* input, double* output, int numSamples,
+                          const double* coeffs, int numTaps)
+{
+    const int taps = NumTaps > 0 ? NumTaps : numTaps;
+    const int half = taps / 2;
+    jassert (NumTaps == 0 || numTaps == NumTaps);
+    int n = 0;
+
+    // 8 outputs per iteration, each coefficient multiplies the sum of its two mirrored inputs
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        const double* x = input + n;
+        const double* xMirror = x - (taps - 1);
+
+        const __m128d centre = _mm_set1_pd (coeffs[half]);
+        __m128d acc0 = _mm_mul_pd (centre, _mm_loadu_pd (x - half));
+        __m128d acc1 = _mm_mul_pd (centre, _mm_loadu_pd (x - half + 2));
+        __m128d acc2 = _mm_mul_pd (centre, _mm_loadu_pd (x - half + 4));
+        __m128d acc3 = _mm_mul_pd (centre, _mm_loadu_pd (x - half + 6));
+
+        for (int k = 0; k < half; k++)
+        {
+            const __m128d c = _mm_set1_pd (coeffs[k]);
+            const double* xk = x - k;
+            const double* xm = xMirror + k;
+            acc0 = _mm_add_pd (acc0, _mm_mul_pd (c, _mm_add_pd (_mm_loadu_pd (xk),     _mm_loadu_pd (xm))));
+            acc1 = _mm_add_pd (acc1, _mm_mul_pd (c, _mm_add_pd (_mm_loadu_pd (xk + 2), _mm_loadu_pd (xm + 2))));
+            acc2 = _mm_add_pd (acc2, _mm_mul_pd (c, _mm_add_pd (_mm_loadu_pd (xk + 4), _mm_loadu_pd (xm + 4))));
+            acc3 = _mm_add_pd (acc3, _mm_mul_pd (c, _mm_add_pd (_mm_loadu_pd (xk + 6), _mm_loadu_pd (xm + 6))));
+        }
+
+        _mm_storeu_pd (output + n,     acc0);
+        _mm_storeu_pd (output + n + 2, acc1);
+        _mm_storeu_pd (output + n + 4, acc2);
+        _mm_storeu_pd (output + n + 6, acc3);
+    }
+
+    for (; n + 2 <= numSamples; n += 2)
+    {
+        const double* x = input + n;
+        const double* xMirror = x - (taps - 1);
+        __m128d acc = _mm_mul_pd (_mm_set1_pd (coeffs[half]), _mm_loadu_pd (x - half));
+
+        for (int k = 0; k < half; k++)
+            acc = _mm_add_pd (acc, _mm_mul_pd (_mm_set1_pd (coeffs[k]), _mm_add_pd (_mm_loadu_pd (x - k), _mm_loadu_pd (xMirror + k))));
+
+        _mm_storeu_pd (output + n, acc);
+    }
+
+    processSymmetricScalar<double, NumTaps> (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+template <int NumTaps>
+FIR_TARGET_AVX2 void processSymmetricAVX2 (const float* input, float* output, int numSamples,
+                                           const float* coeffs, int numTaps)
+{
+    const int taps = NumTaps > 0 ? NumTaps : numTaps;
+    const int half = taps / 2;
+    jassert (NumTaps == 0 || numTaps == NumTaps);
+    int n = 0;
+
+    // 32 outputs per iteration. Each FMA covers two taps, so the accumulator chains
+    // are half as long as in processAVX2 and the loop is bound by the loads instead.
+    for (; n + 32 <= numSamples; n += 32)
+    {
+        const float* x = input + n;
+        const float* xMirror = x - (taps - 1);
+
+        const __m256 centre = _mm256_broadcast_ss (coeffs + half);
+        __m256 acc0 = _mm256_mul_ps (centre, _mm256_loadu_ps (x - half));
+        __m256 acc1 = _mm256_mul_ps (centre, _mm256_loadu_ps (x - half + 8));
+        __m256 acc2 = _mm256_mul_ps (centre, _mm256_loadu_ps (x - half + 16));
+        __m256 acc3 = _mm256_mul_ps (centre, _mm256_loadu_ps (x - half + 24));
+
+        for (int k = 0; k < half; k++)
+        {
+            const __m256 c = _mm256_broadcast_ss (coeffs + k);
+            const float* xk = x - k;
+            const float* xm = xMirror + k;
+            acc0 = _mm256_fmadd_ps (c, _mm256_add_ps (_mm256_loadu_ps (xk),      _mm256_loadu_ps (xm)),      acc0);
+            acc1 = _mm256_fmadd_ps (c, _mm256_add_ps (_mm256_loadu_ps (xk + 8),  _mm256_loadu_ps (xm + 8)),  acc1);
+            acc2 = _mm256_fmadd_ps (c, _mm256_add_ps (_mm256_loadu_ps (xk + 16), _mm256_loadu_ps (xm + 16)), acc2);
+            acc3 = _mm256_fmadd_ps (c, _mm256_add_ps (_mm256_loadu_ps (xk + 24), _mm256_loadu_ps (xm + 24)), acc3);
+        }
+
+        _mm256_storeu_ps (output + n,      acc0);
+        _mm256_storeu_ps (output + n + 8,  acc1);
+        _mm256_storeu_ps (output + n + 16, acc2);
+        _mm256_storeu_ps (output + n + 24, acc3);
+    }
+
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        const float* x = input + n;
+        const float* xMirror = x - (taps - 1);
+        __m256 acc = _mm256_mul_ps (_mm256_broadcast_ss (coeffs + half), _mm256_loadu_ps (x - half));
+
+        for (int k = 0; k < half; k++)
+            acc = _mm256_fmadd_ps (_mm256_broadcast_ss (coeffs + k), _mm256_add_ps (_mm256_loadu_ps (x - k), _mm256_loadu_ps (xMirror + k)), acc);
+
+        _mm256_storeu_ps (output + n, acc);
+    }
+
+    processSymmetricScalar<float, NumTaps> (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+
+template <int NumTaps>
+FIR_TARGET_AVX2 void processSymmetricAVX2 (const double* input, double* output, int numSamples,
+                                           const double* coeffs, int numTaps)
+{
+    const int taps = NumTaps > 0 ? NumTaps : numTaps;
+    const int half = taps / 2;
+    jassert (NumTaps == 0 || numTaps == NumTaps);
+    int n = 0;
+
+    // 16 outputs per iteration, each FMA covers two taps
+    for (; n + 16 <= numSamples; n += 16)
+    {
+        const double* x = input + n;
+        const double* xMirror = x - (taps - 1);
+
+        const __m256d centre = _mm256_broadcast_sd (coeffs + half);
+        __m256d acc0 = _mm256_mul_pd (centre, _mm256_loadu_pd (x - half));
+        __m256d acc1 = _mm256_mul_pd (centre, _mm256_loadu_pd (x - half + 4));
+        __m256d acc2 = _mm256_mul_pd (centre, _mm256_loadu_pd (x - half + 8));
+        __m256d acc3 = _mm256_mul_pd (centre, _mm256_loadu_pd (x - half + 12));
+
+        for (int k = 0; k < half; k++)
+        {
+            const __m256d c = _mm256_broadcast_sd (coeffs + k);
+            const double* xk = x - k;
+            const double* xm = xMirror + k;
+            acc0 = _mm256_fmadd_pd (c, _mm256_add_pd (_mm256_loadu_pd (xk),      _mm256_loadu_pd (xm)),      acc0);
+            acc1 = _mm256_fmadd_pd (c, _mm256_add_pd (_mm256_loadu_pd (xk + 4),  _mm256_loadu_pd (xm + 4)),  acc1);
+            acc2 = _mm256_fmadd_pd (c, _mm256_add_pd (_mm256_loadu_pd (xk + 8),  _mm256_loadu_pd (xm + 8)),  acc2);
+            acc3 = _mm256_fmadd_pd (c, _mm256_add_pd (_mm256_loadu_pd (xk + 12), _mm256_loadu_pd (xm + 12)), acc3);
+        }
+
+        _mm256_storeu_pd (output + n,      acc0);
+        _mm256_storeu_pd (output + n + 4,  acc1);
+        _mm256_storeu_pd (output + n + 8,  acc2);
+        _mm256_storeu_pd (output + n + 12, acc3);
+    }
+
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const double* x = input + n;
+        const double* xMirror = x - (taps - 1);
+        __m256d acc = _mm256_mul_pd (_mm256_broadcast_sd (coeffs + half), _mm256_loadu_pd (x - half));
+
+        for (int k = 0; k < half; k++)
+            acc = _mm256_fmadd_pd (_mm256_broadcast_sd (coeffs + k), _mm256_add_pd (_mm256_loadu_pd (x - k), _mm256_loadu_pd (xMirror + k)), acc);
+
+        _mm256_storeu_pd (output + n, acc);
+    }
+
+    processSymmetricScalar<double, NumTaps> (input + n, output + n, numSamples - n, coeffs, numTaps);
+}
+#endif
+
+template <typename FloatType>
+ProcessFunction<FloatType> getBestProcessFunction()
+{
+   #if JUCE_INTEL
+    if (SystemStats::hasAVX2() && SystemStats::hasFMA3())
+        return processAVX2;
+
+    if (SystemStats::hasSSE2())
+        return processSSE;
+   #endif
+
+    return processScalar<FloatType>;
+}
+
+template ProcessFunction<float> getBestProcessFunction<float>();
+template ProcessFunction<double> getBestProcessFunction<double>();
+
+//==============================================================================
+namespace
+{
+    // The symmetric kernels of one tap count, for each instruction set
+    template <typename FloatType>
+    struct SymmetricKernels
+    {
+        int numTaps;
+        ProcessFunction<FloatType> scalar;
+       #if JUCE_INTEL
+        ProcessFunction<FloatType> sse;
+        ProcessFunction<FloatType> avx2;
+       #endif
+    };
+
+    template <typename FloatType, int NumTaps>
+    SymmetricKernels<FloatType> makeSymmetricKernels()
+    {
+        SymmetricKernels<FloatType> kernels;
+        kernels.numTaps = NumTaps;
+        kernels.scalar = processSymmetricScalar<FloatType, NumTaps>;
+       #if JUCE_INTEL
+        kernels.sse = processSymmetricSSE<NumTaps>;
+        kernels.avx2 = processSymmetricAVX2<NumTaps>;
+       #endif
+        return kernels;
+    }
+}
+
+template <typename FloatType>
+ProcessFunction<FloatType> getSymmetricProcessFunction (int numTaps)
+{
+    jassert (numTaps % 2 == 1);
+
+    // the lengths of the kernel length parameter, ending with the runtime length version
+    static const SymmetricKernels<FloatType> table[] =
+    {
+        makeSymmetricKernels<FloatType, 33>(),
+        makeSymmetricKernels<FloatType, 41>(),
+        makeSymmetricKernels<FloatType, 65>(),
+        makeSymmetricKernels<FloatType, 129>(),
+        makeSymmetricKernels<FloatType, 257>(),
+        makeSymmetricKernels<FloatType, 513>(),
+        makeSymmetricKernels<FloatType, 1025>(),
+        makeSymmetricKernels<FloatType, 2049>(),
+        makeSymmetricKernels<FloatType, 4097>(),
+        makeSymmetricKernels<FloatType, 0>()
+    };
+
+    const SymmetricKernels<FloatType>* kernels = table;
+    while (kernels->numTaps != numTaps && kernels->numTaps != 0)
+        kernels++;
+
+   #if JUCE_INTEL
+    if (SystemStats::hasAVX2() && SystemStats::hasFMA3())
+        return kernels->avx2;
+
+    if (SystemStats::hasSSE2())
+        return kernels->sse;
+   #endif
+
+    return kernels->scalar;
+}
+
+template ProcessFunction<float> getSymmetricProcessFunction<float> (int);
+template ProcessFunction<double> getSymmetricProcessFunction<double> (int);
+
+}
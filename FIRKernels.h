@@ -0,0 +1,50 @@
+// This is the header for the FIR convolution kernels used by the EQ.
+// Every kernel computes y[n] = sum coeffs[k]*x[n-k] for a whole block.
+// The input pointer points at the first new sample, and the numTaps-1
+// samples before it must hold the filter history, so the tap loop
+// never has to check whether it ran off the start of the block.
+// There is a float and a double version of each kernel, so either
+// precision is filtered without converting any samples.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace FIRKernels
+{
+    // Signature shared by all kernels of one sample type. output must not alias input.
+    template <typename FloatType>
+    using ProcessFunction = void (*) (const FloatType* input, FloatType* output, int numSamples,
+                                      const FloatType* coeffs, int numTaps);
+
+    // Portable version, one output sample at a time
+    template <typename FloatType>
+    void processScalar (const FloatType* input, FloatType* output, int numSamples,
+                        const FloatType* coeffs, int numTaps);
+
+   #if JUCE_INTEL
+    // 4 float or 2 double output samples per SSE register
+    void processSSE (const float* input, float* output, int numSamples,
+                     const float* coeffs, int numTaps);
+    void processSSE (const double* input, double* output, int numSamples,
+                     const double* coeffs, int numTaps);
+
+    // 8 float or 4 double output samples per AVX2 register, using fused multiply-add
+    void processAVX2 (const float* input, float* output, int numSamples,
+                      const float* coeffs, int numTaps);
+    void processAVX2 (const double* input, double* output, int numSamples,
+                      const double* coeffs, int numTaps);
+   #endif
+
+    // Picks the fastest kernel for the sample type that the CPU we're running on supports
+    template <typename FloatType>
+    ProcessFunction<FloatType> getBestProcessFunction();
+
+    // Kernels for symmetric coefficients, coeffs[k] == coeffs[numTaps-1-k] with numTaps odd,
+    // as every linear phase kernel is. Mirrored taps share one multiply on the sum of their
+    // two inputs. Picks the fastest version for this CPU from a table with the tap count
+    // fixed at compile time for every length of the kernel length parameter, and a runtime
+    // length version for any other odd tap count.
+    template <typename FloatType>
+    ProcessFunction<FloatType> getSymmetricProcessFunction (int numTaps);
+}
@@ -0,0 +1,33 @@
+// This header holds the factory presets shown as the plug-in's programs.
+// A preset sets the band gains and crossovers, and leaves the kernel length
+// and mode alone, so switching presets never changes the latency.
+
+#pragma once
+
+namespace FactoryPresets
+{
+    struct Preset
+    {
+        const char* name;
+        float loGain;
+        float midGain;
+        float hiGain;
+        float lowCrossover;
+        float highCrossover;
+    };
+    
+    const Preset presets[] =
+    {
+        { "Flat",           1.0f, 1.0f, 1.0f, 500.0f, 4000.0f },
+        { "Low Cut",        0.0f, 1.0f, 1.0f, 120.0f, 4000.0f },
+        { "Bass Boost",     1.5f, 1.0f, 1.0f, 200.0f, 4000.0f },
+        { "Warm",           1.3f, 1.0f, 0.7f, 300.0f, 5000.0f },
+        { "Mud Cut",        1.0f, 0.7f, 1.0f, 250.0f, 1000.0f },
+        { "Vocal",          0.6f, 1.2f, 1.1f, 150.0f, 6000.0f },
+        { "Presence",       1.0f, 1.0f, 1.4f, 500.0f, 3000.0f },
+        { "Air",            1.0f, 1.0f, 1.5f, 500.0f, 10000.0f },
+        { "Telephone",      0.0f, 1.0f, 0.0f, 400.0f, 3400.0f }
+    };
+    
+    const int numPresets = sizeof(presets) / sizeof(presets[0]);
+}
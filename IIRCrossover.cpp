@@ -0,0 +1,303 @@
+// This file contains the Linkwitz-Riley crossover used by the low latency mode.
+// The biquads are transposed direct form II, which keeps the state small and
+// behaves well in single precision down to the lowest crossover frequency.
+
+#include "IIRCrossover.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+namespace
+{
+   #if JUCE_INTEL
+    // One SSE register holds the same sample of all four channels of a group
+    typedef __m128 FloatLanes;
+
+    inline FloatLanes splat (float v)                   { return _mm_set1_ps (v); }
+    inline FloatLanes add (FloatLanes a, FloatLanes b)  { return _mm_add_ps (a, b); }
+    inline FloatLanes sub (FloatLanes a, FloatLanes b)  { return _mm_sub_ps (a, b); }
+    inline FloatLanes mul (FloatLanes a, FloatLanes b)  { return _mm_mul_ps (a, b); }
+    inline FloatLanes load (const float* p)             { return _mm_loadu_ps (p); }
+    inline void store (float* p, FloatLanes v)          { _mm_storeu_ps (p, v); }
+
+    inline FloatLanes gather (float* const* lanes, int n)
+    {
+        return _mm_setr_ps (lanes[0][n], lanes[1][n], lanes[2][n], lanes[3][n]);
+    }
+
+    // Doubles take a pair of SSE2 registers for the four channels
+    struct DoubleLanes { __m128d lo, hi; };
+
+    inline DoubleLanes splat (double v)                     { const __m128d x = _mm_set1_pd (v); return { x, x }; }
+    inline DoubleLanes add (DoubleLanes a, DoubleLanes b)   { return { _mm_add_pd (a.lo, b.lo), _mm_add_pd (a.hi, b.hi) }; }
+    inline DoubleLanes sub (DoubleLanes a, DoubleLanes b)   { return { _mm_sub_pd (a.lo, b.lo), _mm_sub_pd (a.hi, b.hi) }; }
+    inline DoubleLanes mul (DoubleLanes a, DoubleLanes b)   { return { _mm_mul_pd (a.lo, b.lo), _mm_mul_pd (a.hi, b.hi) }; }
+    inline DoubleLanes load (const double* p)               { return { _mm_loadu_pd (p), _mm_loadu_pd (p + 2) }; }
+    inline void store (double* p, DoubleLanes v)            { _mm_storeu_pd (p, v.lo); _mm_storeu_pd (p + 2, v.hi); }
+
+    inline DoubleLanes gather (double* const* lanes, int n)
+    {
+        return { _mm_setr_pd (lanes[0][n], lanes[1][n]), _mm_setr_pd (lanes[2][n], lanes[3][n]) };
+    }
+   #else
+    // Plain arrays elsewhere, which the compiler can still map onto NEON
+    template <typename FloatType>
+    struct ArrayLanes { FloatType v[4]; };
+
+    typedef ArrayLanes<float> FloatLanes;
+    typedef ArrayLanes<double> DoubleLanes;
+
+    template <typename T> inline ArrayLanes<T> splat (T v)                              { return {{ v, v, v, v }}; }
+    template <typename T> inline ArrayLanes<T> add (ArrayLanes<T> a, ArrayLanes<T> b)   { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+    template <typename T> inline ArrayLanes<T> sub (ArrayLanes<T> a, ArrayLanes<T> b)   { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+    template <typename T> inline ArrayLanes<T> mul (ArrayLanes<T> a, ArrayLanes<T> b)   { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+    template <typename T> inline ArrayLanes<T> load (const T* p)                        { return {{ p[0], p[1], p[2], p[3] }}; }
+    template <typename T> inline void store (T* p, ArrayLanes<T> v)                     { for (int i = 0; i < 4; i++) p[i] = v.v[i]; }
+
+    template <typename T>
+    inline ArrayLanes<T> gather (T* const* lanes, int n)
+    {
+        return {{ lanes[0][n], lanes[1][n], lanes[2][n], lanes[3][n] }};
+    }
+   #endif
+
+    // Lane type for each sample type
+    template <typename FloatType> struct LanesFor;
+    template <> struct LanesFor<float>  { typedef FloatLanes Type; };
+    template <> struct LanesFor<double> { typedef DoubleLanes Type; };
+
+    // Butterworth Q, two of these in series make one Linkwitz-Riley section
+    const double butterworthQ = 0.7071067811865476;
+
+    enum FilterType { lowpass, highpass, allpass };
+}
+
+//==============================================================================
+template <typename FloatType>
+IIRCrossover<FloatType>::IIRCrossover()
+{
+    setCrossovers (44100.0, 500.0f, 4000.0f);
+}
+
+template <typename FloatType>
+IIRCrossover<FloatType>::~IIRCrossover() {}
+
+template <typename FloatType>
+void IIRCrossover<FloatType>::prepare (int numChannels, int maxBlockSize)
+{
+    numGroups = (numChannels + channelsPerGroup - 1) / channelsPerGroup;
+    groups.calloc ((size_t) numGroups);
+
+    spareLanes.setSize (channelsPerGroup - 1, maxBlockSize);
+    spareLanes.clear();
+
+    setGains (targetGains[0], targetGains[1], targetGains[2], 0);
+}
+
+template <typename FloatType>
+void IIRCrossover<FloatType>::reset()
+{
+    for (int group = 0; group < numGroups; group++)
+    {
+        zeromem (groups[group].s1, sizeof (groups[group].s1));
+        zeromem (groups[group].s2, sizeof (groups[group].s2));
+    }
+}
+
+template <typename FloatType>
+void IIRCrossover<FloatType>::resetGroup (int group)
+{
+    GroupState& state = groups[group];
+    zeromem (state.s1, sizeof (state.s1));
+    zeromem (state.s2, sizeof (state.s2));
+
+    for (int band = 0; band < 3; band++)
+        state.gains[band] = targetGains[band];
+
+    state.rampSamplesRemaining = 0;
+}
+
+template <typename FloatType>
+void IIRCrossover<FloatType>::setCrossovers (double sampleRate, float lowFrequency, float highFrequency)
+{
+    // keep both crossovers clear of Nyquist, where the bilinear transform squashes them together
+    const double nyquist = 0.5 * sampleRate;
+    const double low = jlimit (10.0, 0.4 * nyquist, (double) lowFrequency);
+    const double high = jlimit (low, 0.9 * nyquist, (double) highFrequency);
+
+    auto design = [sampleRate] (FilterType type, double frequency)
+    {
+        // RBJ cookbook biquads
+        const double w0 = MathConstants<double>::twoPi * frequency / sampleRate;
+        const double cosW0 = std::cos (w0);
+        const double alpha = std::sin (w0) / (2.0 * butterworthQ);
+        const double a0 = 1.0 + alpha;
+
+        double b0, b1, b2;
+
+        if (type == lowpass)
+        {
+            b0 = b2 = 0.5 * (1.0 - cosW0);
+            b1 = 1.0 - cosW0;
+        }
+        else if (type == highpass)
+        {
+            b0 = b2 = 0.5 * (1.0 + cosW0);
+            b1 = -(1.0 + cosW0);
+        }
+        else
+        {
+            // a Linkwitz-Riley lowpass plus its highpass is exactly this allpass
+            b0 = 1.0 - alpha;
+            b1 = -2.0 * cosW0;
+            b2 = 1.0 + alpha;
+        }
+
+        Coefficients c;
+        c.b0 = (FloatType) (b0 / a0);
+        c.b1 = (FloatType) (b1 / a0);
+        c.b2 = (FloatType) (b2 / a0);
+        c.a1 = (FloatType) (-2.0 * cosW0 / a0);
+        c.a2 = (FloatType) ((1.0 - alpha) / a0);
+        return c;
+    };
+
+    coefficients[lowLowpass1] = coefficients[lowLowpass2] = design (lowpass, low);
+    coefficients[splitHighpass1] = coefficients[splitHighpass2] = design (highpass, low);
+    coefficients[lowAllpass] = design (allpass, high);
+    coefficients[midLowpass1] = coefficients[midLowpass2] = design (lowpass, high);
+    coefficients[highHighpass1] = coefficients[highHighpass2] = design (highpass, high);
+}
+
+template <typename FloatType>
+void IIRCrossover<FloatType>::setGains (float lo, float mid, float hi, int rampLength)
+{
+    targetGains[0] = lo;
+    targetGains[1] = mid;
+    targetGains[2] = hi;
+
+    for (int group = 0; group < numGroups; group++)
+    {
+        GroupState& state = groups[group];
+
+        // a ramp that is still running carries on from wherever it has got to
+        for (int band = 0; band < 3; band++)
+        {
+            if (rampLength > 0)
+                state.gainSteps[band] = (targetGains[band] - state.gains[band]) / rampLength;
+            else
+                state.gains[band] = targetGains[band];
+        }
+
+        state.rampSamplesRemaining = rampLength;
+    }
+}
+
+template <typename FloatType>
+void IIRCrossover<FloatType>::process (int group, FloatType* const* channels, int numChannels, int numSamples,
+                                       FloatType* const* const* bands)
+{
+    // only the last group of a block can be short of channels,
+    // so two threads never write to the spare lanes at once
+    jassert (group < numGroups && numChannels > 0 && numChannels <= channelsPerGroup);
+    jassert (numSamples <= spareLanes.getNumSamples());
+
+    typedef typename LanesFor<FloatType>::Type Lanes;
+    GroupState& state = groups[group];
+
+    FloatType* lanes[channelsPerGroup];
+    for (int lane = 0; lane < channelsPerGroup; lane++)
+        lanes[lane] = lane < numChannels ? channels[lane] : spareLanes.getWritePointer (lane - 1);
+
+    // Coefficients and state are splatted into locals for the whole block, outside the
+    // state struct. That is 63 vectors, more than there are registers, so most of them
+    // spill to the stack, but they stay in L1 and the splats happen once per block.
+    Lanes b0[numFilters], b1[numFilters], b2[numFilters], a1[numFilters], a2[numFilters];
+    Lanes s1[numFilters], s2[numFilters];
+
+    for (int f = 0; f < numFilters; f++)
+    {
+        b0[f] = splat (coefficients[f].b0);
+        b1[f] = splat (coefficients[f].b1);
+        b2[f] = splat (coefficients[f].b2);
+        a1[f] = splat (coefficients[f].a1);
+        a2[f] = splat (coefficients[f].a2);
+        s1[f] = load (state.s1[f]);
+        s2[f] = load (state.s2[f]);
+    }
+
+    auto biquad = [&] (int f, Lanes x)
+    {
+        Lanes y = add (mul (b0[f], x), s1[f]);
+        s1[f] = sub (add (mul (b1[f], x), s2[f]), mul (a1[f], y));
+        s2[f] = sub (mul (b2[f], x), mul (a2[f], y));
+        return y;
+    };
+
+    const int rampSamples = jmin (numSamples, state.rampSamplesRemaining);
+    FloatType out[channelsPerGroup];
+
+    for (int n = 0; n < numSamples; n++)
+    {
+        if (n < rampSamples)
+        {
+            for (int band = 0; band < 3; band++)
+                state.gains[band] += state.gainSteps[band];
+        }
+
+        const Lanes x = gather (lanes, n);
+
+        // upper crossover allpass keeps the low band in phase with the other two
+        Lanes lo = biquad (lowLowpass1, x);
+        lo = biquad (lowLowpass2, lo);
+        lo = biquad (lowAllpass, lo);
+
+        Lanes rest = biquad (splitHighpass1, x);
+        rest = biquad (splitHighpass2, rest);
+
+        Lanes mid = biquad (midLowpass1, rest);
+        mid = biquad (midLowpass2, mid);
+
+        Lanes hi = biquad (highHighpass1, rest);
+        hi = biquad (highHighpass2, hi);
+
+        const Lanes weighted[3] = { mul (splat (state.gains[0]), lo),
+                                    mul (splat (state.gains[1]), mid),
+                                    mul (splat (state.gains[2]), hi) };
+        const Lanes y = add (add (weighted[0], weighted[1]), weighted[2]);
+
+        store (out, y);
+        for (int lane = 0; lane < channelsPerGroup; lane++)
+            lanes[lane][n] = out[lane];
+
+        // the same products the output is summed from
+        if (bands != nullptr)
+        {
+            for (int band = 0; band < 3; band++)
+            {
+                if (bands[band] == nullptr)
+                    continue;
+
+                store (out, weighted[band]);
+                for (int lane = 0; lane < numChannels; lane++)
+                    bands[band][lane][n] = out[lane];
+            }
+        }
+    }
+
+    // land exactly on the target once the ramp is over
+    state.rampSamplesRemaining -= rampSamples;
+    if (state.rampSamplesRemaining == 0)
+        for (int band = 0; band < 3; band++)
+            state.gains[band] = targetGains[band];
+
+    for (int f = 0; f < numFilters; f++)
+    {
+        store (state.s1[f], s1[f]);
+        store (state.s2[f], s2[f]);
+    }
+}
+
+template class IIRCrossover<float>;
+template class IIRCrossover<double>;
@@ -0,0 +1,88 @@
+// This is the header for the low latency IIR filter engine.
+// Two 4th order Linkwitz-Riley crossovers split the signal into low, mid
+// and high bands. The low band also runs through the allpass of the upper
+// crossover, so all three bands stay in phase and sum back to a flat
+// magnitude response when the gains are equal. It adds no latency, and
+// each channel costs 9 biquads per sample instead of a full FIR kernel.
+//
+// Channels are processed in groups of four, one channel per SIMD lane,
+// so every biquad runs once per sample for the whole group. The class is
+// templated on the sample type, and the double version keeps its
+// coefficients and state in double as well.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+template <typename FloatType>
+class IIRCrossover
+{
+public:
+    IIRCrossover();
+    ~IIRCrossover();
+
+    // Channels that share one SIMD register
+    static const int channelsPerGroup = 4;
+
+    // Allocates filter state for the given channel count and largest block. Not realtime safe.
+    void prepare (int numChannels, int maxBlockSize);
+
+    // Clears the filter state of every channel
+    void reset();
+
+    // Clears the filter state of one group and finishes its gain ramp,
+    // for a group that is not being processed
+    void resetGroup (int group);
+
+    // Recalculates the biquad coefficients. This doesn't allocate or touch
+    // the filter state, so it can be called on the audio thread between blocks.
+    void setCrossovers (double sampleRate, float lowFrequency, float highFrequency);
+
+    // Ramps the band gains linearly to new values over rampLength samples,
+    // or jumps straight to them if rampLength is 0
+    void setGains (float lo, float mid, float hi, int rampLength);
+
+    // Filters numSamples of one group of up to channelsPerGroup channels in place.
+    // If bands is given, bands[band][channel] also gets the low, mid and high band of each
+    // channel with its gain applied, and they sum to the output. A band may be nullptr.
+    // Different groups may be processed on different threads at the same time.
+    void process (int group, FloatType* const* channels, int numChannels, int numSamples,
+                  FloatType* const* const* bands = nullptr);
+
+private:
+    // Normalised transposed direct form II coefficients, a0 is 1
+    struct Coefficients
+    {
+        FloatType b0, b1, b2, a1, a2;
+    };
+
+    enum Filters
+    {
+        lowLowpass1, lowLowpass2, lowAllpass,
+        splitHighpass1, splitHighpass2,
+        midLowpass1, midLowpass2,
+        highHighpass1, highHighpass2,
+        numFilters
+    };
+
+    // Filter state and gain ramp of one group, one sample per lane
+    struct GroupState
+    {
+        FloatType s1[numFilters][channelsPerGroup];
+        FloatType s2[numFilters][channelsPerGroup];
+        FloatType gains[3];
+        FloatType gainSteps[3];
+        int rampSamplesRemaining;
+    };
+
+    Coefficients coefficients[numFilters];
+    HeapBlock<GroupState> groups;
+    int numGroups = 0;
+
+    // Input and output of lanes without a channel, so the inner loop never branches
+    AudioBuffer<FloatType> spareLanes;
+
+    FloatType targetGains[3] = { 1, 1, 1 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IIRCrossover)
+};
@@ -0,0 +1,84 @@
+// This file contains the shared kernel cache. Lookups are a linear search,
+// which is fine for the few dozen sets a session holds at once. The lock is
+// taken on the message thread, in prepareToPlay and on the designer threads,
+// never on the audio thread, which hands its references back through the designer.
+
+#include "KernelCache.h"
+
+//==============================================================================
+KernelCache::KernelCache() {}
+
+KernelCache::~KernelCache()
+{
+    // every instance should have released its sets by now
+    jassert (kernelSets.isEmpty());
+}
+
+const EQKernelSet* KernelCache::acquire (const KernelSettings& settings)
+{
+    // the designer rounds the length up to odd, so look for what it would have made
+    KernelSettings designed = settings;
+    designed.length |= 1;
+
+    {
+        const ScopedLock sl (lock);
+
+        if (EQKernelSet* kernelSet = find (designed))
+        {
+            addReference (kernelSet);
+            return kernelSet;
+        }
+    }
+
+    // two threads may both get here for the same settings, add() keeps the first
+    return add (KernelDesigner::design (designed));
+}
+
+const EQKernelSet* KernelCache::add (EQKernelSet* kernelSet)
+{
+    const ScopedLock sl (lock);
+
+    if (kernelSet->designed)
+    {
+        if (EQKernelSet* existing = find (kernelSet->settings))
+        {
+            delete kernelSet;
+            kernelSet = existing;
+        }
+    }
+
+    if (! kernelSets.contains (kernelSet))
+        kernelSets.add (kernelSet);
+
+    addReference (kernelSet);
+    return kernelSet;
+}
+
+void KernelCache::release (const EQKernelSet* kernelSet)
+{
+    if (kernelSet == nullptr)
+        return;
+
+    const ScopedLock sl (lock);
+    jassert (kernelSet->references > 0);
+
+    // the audio thread only takes references without the lock to sets its own instance
+    // still holds, so nothing can bring this one back once it reaches 0
+    if (--kernelSet->references == 0)
+        kernelSets.removeObject (const_cast<EQKernelSet*> (kernelSet));
+}
+
+int KernelCache::getNumKernelSets() const
+{
+    const ScopedLock sl (lock);
+    return kernelSets.size();
+}
+
+EQKernelSet* KernelCache::find (const KernelSettings& settings) const
+{
+    for (auto* kernelSet : kernelSets)
+        if (kernelSet->designed && kernelSet->settings == settings)
+            return kernelSet;
+
+    return nullptr;
+}
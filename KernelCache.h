@@ -0,0 +1,49 @@
+// This is the header for the process-wide kernel cache. Every kernel set an
+// instance uses is held here with a reference count, so a session full of EQs
+// at the same settings designs and stores each set only once, whether it was
+// precomputed for a preset or designed after a parameter change. Sets are
+// immutable once added and are deleted as soon as nothing refers to them.
+// Each set keeps all of its coefficients in one allocation aligned to a
+// cache line (EQKernelSet::allocate), so the instances sharing it read the
+// same lines of L2 and no two sets ever share one.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "KernelDesigner.h"
+
+class KernelCache
+{
+public:
+    KernelCache();
+    ~KernelCache();
+
+    // Returns the set designed for these settings with a reference taken for the caller,
+    // designing it first if nothing holds one yet. The design runs outside the lock, so
+    // other threads can still look up sets meanwhile. Safe from any thread except the audio thread.
+    const EQKernelSet* acquire (const KernelSettings& settings);
+
+    // Takes over a set the caller has just made and returns it with a reference taken.
+    // If a designed set for the same settings is already held, that one is returned
+    // instead and the new one deleted. Not the audio thread.
+    const EQKernelSet* add (EQKernelSet* kernelSet);
+
+    // Takes another reference to a set the caller already holds one to. This never
+    // locks, so it is safe on the audio thread.
+    static void addReference (const EQKernelSet* kernelSet)   { ++kernelSet->references; }
+
+    // Drops a reference, deleting the set if it was the last one. Not the audio thread.
+    void release (const EQKernelSet* kernelSet);
+
+    // Number of sets currently held, for diagnostics
+    int getNumKernelSets() const;
+
+private:
+    // Designed set for these settings, or nullptr. Called with the lock held.
+    EQKernelSet* find (const KernelSettings& settings) const;
+
+    CriticalSection lock;
+    OwnedArray<EQKernelSet> kernelSets;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (KernelCache)
+};
@@ -0,0 +1,547 @@
+// This file contains the Kaiser windowed sinc designer for the band kernels
+// and the background thread that runs it. Requests only store the new
+// settings, and finished sets go to the audio thread through an atomic
+// pointer. The audio thread hands old sets back through a FIFO, so it never
+// has to delete anything itself. Signalling the thread would take the
+// event's mutex, so the audio thread doesn't wake it, the thread checks
+// for requests and retired sets every pollIntervalMs instead.
+
+#include "KernelDesigner.h"
+#include "KernelCache.h"
+#include "FFTConvolver.h"
+
+namespace
+{
+    // Stopband attenuation of the Kaiser window in dB
+    const double stopbandAttenuation = 80.0;
+
+    // Zeroth order modified Bessel function of the first kind, by its power series
+    double besselI0 (double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+
+        for (int k = 1; k < 50; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+
+            if (term < sum * 1.0e-12)
+                break;
+        }
+
+        return sum;
+    }
+
+    // Linear phase lowpass at cutoff Hz with unity gain at DC
+    void designLowpass (double* kernel, int length, double cutoff, double sampleRate)
+    {
+        const double beta = 0.1102 * (stopbandAttenuation - 8.7);
+        const double normalisedCutoff = cutoff / sampleRate;
+        const double centre = 0.5 * (length - 1);
+        double sum = 0.0;
+
+        for (int n = 0; n < length; n++)
+        {
+            const double t = n - centre;
+            const double sinc = t == 0.0 ? 2.0 * normalisedCutoff
+                                         : std::sin (2.0 * MathConstants<double>::pi * normalisedCutoff * t) / (MathConstants<double>::pi * t);
+
+            const double r = centre > 0.0 ? t / centre : 0.0;
+            const double window = besselI0 (beta * std::sqrt (jmax (0.0, 1.0 - r * r))) / besselI0 (beta);
+
+            kernel[n] = sinc * window;
+            sum += kernel[n];
+        }
+
+        for (int n = 0; n < length; n++)
+            kernel[n] /= sum;
+    }
+
+    // Odd Kaiser window length that reaches the stopband within transitionWidth Hz
+    int getKaiserLength (double transitionWidth, double sampleRate)
+    {
+        const double width = MathConstants<double>::twoPi * transitionWidth / sampleRate;
+        return ((int) std::ceil ((stopbandAttenuation - 8.0) / (2.285 * width)) + 1) | 1;
+    }
+
+    // Top of the low crossover parameter's range, the multirate low band always passes twice this
+    const double maxLowCrossover = 1000.0;
+
+    // The resampler eats into the low rate kernel's share of the delay, so the multirate
+    // low band is a little less steep than a full rate one. Below this fraction it's not worth it.
+    const double minRelativeSteepness = 0.8;
+
+    // Partition spectra of the three bands, in the precision of the convolver they are for
+    template <typename FloatType>
+    void transformBands (const EQKernelSet& kernelSet, int length, int partitionSize, FloatType* spectra)
+    {
+        int order = 0;
+        while ((1 << order) < 2 * partitionSize)
+            order++;
+
+        RealFFT<FloatType> fft (order);
+        HeapBlock<FloatType> workSpace ((size_t) (4 * partitionSize));
+
+        for (int band = 0; band < 3; band++)
+            FFTConvolver<FloatType>::transformKernel (fft, partitionSize, kernelSet.bands.getReadPointer (band), length,
+                                                      spectra + band * kernelSet.numPartitions * kernelSet.spectrumSize,
+                                                      workSpace);
+    }
+
+    // Makes a set of the given layout from band kernels of layout.length taps, with the
+    // partition spectra precomputed here rather than on the audio thread
+    EQKernelSet* createKernelSet (const float* lo, const float* mid, const float* hi,
+                                  EQKernelSet::Layout layout, const KernelSettings& settings)
+    {
+        const int length = layout.length;
+        const int partitionSize = settings.partitionSize;
+
+        if (partitionSize > 0)
+        {
+            layout.numPartitions = FFTConvolver<float>::getNumPartitions (length, partitionSize);
+            layout.spectrumSize = FFTConvolver<float>::getSpectrumSize (partitionSize);
+            layout.doubleSpectra = settings.doublePrecision;
+        }
+
+        EQKernelSet* kernelSet = new EQKernelSet();
+        kernelSet->settings = settings;
+        kernelSet->settings.length = length;
+        kernelSet->numTaps = length;
+        kernelSet->allocate (layout);
+
+        kernelSet->bands.copyFrom (0, 0, lo, length);
+        kernelSet->bands.copyFrom (1, 0, mid, length);
+        kernelSet->bands.copyFrom (2, 0, hi, length);
+
+        if (partitionSize > 0 && settings.doublePrecision)
+            transformBands (*kernelSet, length, partitionSize, kernelSet->doubleSpectra);
+        else if (partitionSize > 0)
+            transformBands (*kernelSet, length, partitionSize, kernelSet->spectra);
+
+        return kernelSet;
+    }
+
+    // Designs a set whose low band runs decimated, or returns nullptr when the
+    // sample rate is too low or the kernel too short for it to pay off
+    EQKernelSet* designMultirate (const KernelSettings& settings, int length, double lowCutoff, double highCutoff)
+    {
+        // a power of two, so blocks of 64 samples and up all start on a decimation instant
+        int decimation = KernelDesigner::maxDecimation;
+        while (decimation > 1 && settings.sampleRate < 12.0 * maxLowCrossover * decimation)
+            decimation /= 2;
+
+        if (decimation < KernelDesigner::minDecimation)
+            return nullptr;
+
+        // the resampler stops before anything above twice the top crossover can alias into it
+        const double lowRate = settings.sampleRate / decimation;
+        const int resamplerLength = getKaiserLength (lowRate - 4.0 * maxLowCrossover, settings.sampleRate);
+        const int phaseLength = (resamplerLength + decimation - 1) / decimation;
+
+        // the decimator and interpolator each delay by half the resampler,
+        // the low rate kernel gets whatever is left of the full kernel's delay
+        const int centre = length / 2;
+        const int lowRateCentre = (centre - (resamplerLength - 1)) / decimation;
+
+        if (phaseLength > KernelDesigner::maxPhaseLength
+             || 2 * decimation * lowRateCentre < minRelativeSteepness * (length - 1))
+            return nullptr;
+
+        const int lowRateLength = 2 * lowRateCentre + 1;
+
+        // the full rate kernels now only need to be as steep in octaves
+        // around the high crossover as the low rate kernel is around the low one.
+        // This is rarely one of the tap counts FIRKernels has compiled in, so they
+        // run the runtime length kernel. It is within a few percent of those per tap,
+        // where padding up to the next compiled count could double the taps.
+        const int numTaps = jlimit (33, length, (int) (length * lowCutoff / highCutoff)) | 1;
+        const int firstTap = centre - numTaps / 2;
+
+        HeapBlock<double> resampler (resamplerLength);
+        HeapBlock<double> lowpass (lowRateLength);
+        HeapBlock<double> highLowpass (numTaps);
+        designLowpass (resampler, resamplerLength, 0.5 * lowRate, settings.sampleRate);
+        designLowpass (lowpass, lowRateLength, lowCutoff, lowRate);
+        designLowpass (highLowpass, numTaps, highCutoff, settings.sampleRate);
+
+        // lo is empty, mid = LP(high) and hi = delta - LP(high), so mid + hi = delta
+        // and the multirate path adds (g_lo - g_mid) * LP(low) on top
+        HeapBlock<float> lo (length, true);
+        HeapBlock<float> mid (length, true);
+        HeapBlock<float> hi (length, true);
+
+        for (int n = 0; n < numTaps; n++)
+        {
+            const double delta = n == numTaps / 2 ? 1.0 : 0.0;
+            mid[firstTap + n] = (float) highLowpass[n];
+            hi[firstTap + n] = (float) (delta - highLowpass[n]);
+        }
+
+        // the trimmed kernels are short enough for direct form, so no spectra are needed,
+        // but the set keeps the settings it was asked for so it can be looked up by them
+        KernelSettings designed = settings;
+        designed.length = length;
+        designed.partitionSize = 0;
+
+        EQKernelSet::Layout layout;
+        layout.length = length;
+        layout.decimation = decimation;
+        layout.resamplerLength = resamplerLength;
+        layout.lowRateLength = lowRateLength;
+        layout.phaseLength = phaseLength;
+
+        EQKernelSet* kernelSet = createKernelSet (lo, mid, hi, layout, designed);
+        kernelSet->settings.partitionSize = settings.partitionSize;
+        kernelSet->firstTap = firstTap;
+        kernelSet->numTaps = numTaps;
+
+        MultirateLowBand& multirate = kernelSet->multirate;
+        multirate.decimation = decimation;
+        multirate.delay = centre - (resamplerLength - 1) - decimation * lowRateCentre;
+
+        for (int n = 0; n < resamplerLength; n++)
+            multirate.resampler.setSample (0, n, (float) resampler[n]);
+        for (int n = 0; n < lowRateLength; n++)
+            multirate.lowpass.setSample (0, n, (float) lowpass[n]);
+
+        // phase p of the interpolator takes taps p, p + decimation, p + 2 * decimation...
+        for (int n = 0; n < resamplerLength; n++)
+            multirate.phases.setSample (n % decimation, n / decimation, (float) (decimation * resampler[n]));
+
+        return kernelSet;
+    }
+}
+
+//==============================================================================
+KernelDesigner::KernelDesigner()
+    : Thread ("EQ kernel designer"),
+      requestedSampleRate (44100.0),
+      requestedLowCrossover (500.0f),
+      requestedHighCrossover (4000.0f),
+      requestedLength (129),
+      requestedPartitionSize (0),
+      requestedDoublePrecision (false),
+      requestedAllowMultirate (true),
+      designRequested (false),
+      pendingKernels (nullptr),
+      retiredFifo (retiredCapacity)
+{
+    for (int i = 0; i < maxPrecomputed; i++)
+        precomputedKernels[i] = nullptr;
+
+    startThread (3);
+}
+
+KernelDesigner::~KernelDesigner()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (4000);
+
+    releaseRetiredKernels();
+
+    if (const EQKernelSet* pending = pendingKernels.exchange (nullptr))
+        kernelCache->release (pending);
+
+    for (int i = 0; i < maxPrecomputed; i++)
+        if (const EQKernelSet* precomputed = precomputedKernels[i].exchange (nullptr))
+            kernelCache->release (precomputed);
+}
+
+EQKernelSet* KernelDesigner::design (const KernelSettings& settings)
+{
+    // odd lengths keep the kernels symmetric around a whole sample of delay
+    const int length = settings.length | 1;
+    const double nyquist = 0.5 * settings.sampleRate;
+    const double lowCutoff = jlimit (1.0, 0.45 * nyquist, (double) settings.lowCrossover);
+    const double highCutoff = jlimit (lowCutoff, 0.95 * nyquist, (double) settings.highCrossover);
+
+    if (settings.allowMultirate)
+    {
+        if (EQKernelSet* multirate = designMultirate (settings, length, lowCutoff, highCutoff))
+        {
+            multirate->designed = true;
+            return multirate;
+        }
+    }
+
+    HeapBlock<double> lowpass (length);
+    HeapBlock<double> highLowpass (length);
+    designLowpass (lowpass, length, lowCutoff, settings.sampleRate);
+    designLowpass (highLowpass, length, highCutoff, settings.sampleRate);
+
+    // lo = LP(low), hi = delta - LP(high), mid = LP(high) - LP(low), so lo + mid + hi = delta
+    HeapBlock<float> lo (length);
+    HeapBlock<float> mid (length);
+    HeapBlock<float> hi (length);
+
+    for (int n = 0; n < length; n++)
+    {
+        const double delta = n == length / 2 ? 1.0 : 0.0;
+        lo[n] = (float) lowpass[n];
+        mid[n] = (float) (highLowpass[n] - lowpass[n]);
+        hi[n] = (float) (delta - highLowpass[n]);
+    }
+
+    KernelSettings designed = settings;
+    designed.length = length;
+
+    EQKernelSet* kernelSet = createFromBands (lo, mid, hi, length, designed);
+    kernelSet->designed = true;
+    return kernelSet;
+}
+
+EQKernelSet* KernelDesigner::createFromBands (const float* lo, const float* mid, const float* hi,
+                                              int length, const KernelSettings& settings)
+{
+    EQKernelSet::Layout layout;
+    layout.length = length;
+    return createKernelSet (lo, mid, hi, layout, settings);
+}
+
+//==============================================================================
+void EQKernelSet::allocate (const Layout& layout)
+{
+    // every buffer is rounded up to whole cache lines
+    const int lineFloats = cacheLineSize / (int) sizeof (float);
+    auto lines = [lineFloats] (int numFloats) { return (numFloats + lineFloats - 1) / lineFloats * lineFloats; };
+
+    const int bandSize = lines (layout.length);
+    // double spectra take the room of two floats per value
+    const int spectraSize = lines (3 * layout.numPartitions * layout.spectrumSize * (layout.doubleSpectra ? 2 : 1));
+    const int resamplerSize = lines (layout.resamplerLength);
+    const int lowRateSize = lines (layout.lowRateLength);
+    const int phaseSize = lines (layout.phaseLength);
+    const int numFloats = 3 * bandSize + spectraSize + resamplerSize + lowRateSize + layout.decimation * phaseSize;
+
+    // HeapBlock only promises malloc's alignment, so take a line extra and start on the next boundary
+    storage.calloc ((size_t) numFloats * sizeof (float) + cacheLineSize);
+    float* next = reinterpret_cast<float*> ((reinterpret_cast<pointer_sized_int> (storage.get()) + cacheLineSize)
+                                              & ~(pointer_sized_int) (cacheLineSize - 1));
+
+    float* channels[KernelDesigner::maxDecimation];
+
+    for (int band = 0; band < 3; band++)
+        channels[band] = next + band * bandSize;
+    bands.setDataToReferTo (channels, 3, layout.length);
+    next += 3 * bandSize;
+
+    numPartitions = layout.numPartitions;
+    spectrumSize = layout.spectrumSize;
+    spectra = spectraSize > 0 && ! layout.doubleSpectra ? next : nullptr;
+    doubleSpectra = spectraSize > 0 && layout.doubleSpectra ? reinterpret_cast<double*> (next) : nullptr;
+    next += spectraSize;
+
+    if (layout.decimation > 0)
+    {
+        channels[0] = next;
+        multirate.resampler.setDataToReferTo (channels, 1, layout.resamplerLength);
+        next += resamplerSize;
+
+        channels[0] = next;
+        multirate.lowpass.setDataToReferTo (channels, 1, layout.lowRateLength);
+        next += lowRateSize;
+
+        jassert (layout.decimation <= KernelDesigner::maxDecimation);
+        for (int phase = 0; phase < layout.decimation; phase++)
+            channels[phase] = next + phase * phaseSize;
+        multirate.phases.setDataToReferTo (channels, layout.decimation, layout.phaseLength);
+    }
+}
+
+void KernelDesigner::requestDesign (const KernelSettings& settings)
+{
+    const uint32 sequence = requestSequence.load (std::memory_order_relaxed);
+    requestSequence.store (sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    requestedSampleRate.store (settings.sampleRate, std::memory_order_relaxed);
+    requestedLowCrossover.store (settings.lowCrossover, std::memory_order_relaxed);
+    requestedHighCrossover.store (settings.highCrossover, std::memory_order_relaxed);
+    requestedLength.store (settings.length, std::memory_order_relaxed);
+    requestedPartitionSize.store (settings.partitionSize, std::memory_order_relaxed);
+    requestedDoublePrecision.store (settings.doublePrecision, std::memory_order_relaxed);
+    requestedAllowMultirate.store (settings.allowMultirate, std::memory_order_relaxed);
+
+    requestSequence.store (sequence + 2, std::memory_order_release);
+    designRequested = true;
+}
+
+KernelSettings KernelDesigner::readRequest() const
+{
+    for (;;)
+    {
+        const uint32 sequence = requestSequence.load (std::memory_order_acquire);
+
+        if ((sequence & 1) == 0)
+        {
+            KernelSettings settings;
+            settings.sampleRate = requestedSampleRate.load (std::memory_order_relaxed);
+            settings.lowCrossover = requestedLowCrossover.load (std::memory_order_relaxed);
+            settings.highCrossover = requestedHighCrossover.load (std::memory_order_relaxed);
+            settings.length = requestedLength.load (std::memory_order_relaxed);
+            settings.partitionSize = requestedPartitionSize.load (std::memory_order_relaxed);
+            settings.doublePrecision = requestedDoublePrecision.load (std::memory_order_relaxed);
+            settings.allowMultirate = requestedAllowMultirate.load (std::memory_order_relaxed);
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+            if (requestSequence.load (std::memory_order_relaxed) == sequence)
+                return settings;
+        }
+
+        // the audio thread is part way through a write, which only takes a moment
+        Thread::yield();
+    }
+}
+
+void KernelDesigner::publish (const EQKernelSet* kernelSet)
+{
+    // a set the audio thread never picked up can go straight away
+    if (const EQKernelSet* unused = pendingKernels.exchange (kernelSet))
+        kernelCache->release (unused);
+}
+
+const EQKernelSet* KernelDesigner::getNewKernels()
+{
+    // only take a new set if there's room to hand the old one back
+    if (! canRetire())
+        return nullptr;
+
+    return pendingKernels.exchange (nullptr);
+}
+
+void KernelDesigner::retire (const EQKernelSet* kernelSet)
+{
+    if (kernelSet == nullptr)
+        return;
+
+    int start1, size1, start2, size2;
+    retiredFifo.prepareToWrite (1, start1, size1, start2, size2);
+    jassert (size1 == 1);
+    retiredKernels[start1] = kernelSet;
+    retiredFifo.finishedWrite (1);
+}
+
+void KernelDesigner::releaseRetiredKernels()
+{
+    int start1, size1, start2, size2;
+    const int numReady = retiredFifo.getNumReady();
+    retiredFifo.prepareToRead (numReady, start1, size1, start2, size2);
+
+    for (int i = 0; i < size1; i++)
+        kernelCache->release (retiredKernels[start1 + i]);
+
+    for (int i = 0; i < size2; i++)
+        kernelCache->release (retiredKernels[start2 + i]);
+
+    retiredFifo.finishedRead (size1 + size2);
+}
+
+void KernelDesigner::requestPrecomputed (int slot, const KernelSettings& settings)
+{
+    jassert (slot >= 0 && slot < maxPrecomputed);
+
+    {
+        const ScopedLock sl (slotLock);
+        slotRequests[slot].settings = settings;
+        slotRequests[slot].pending = true;
+        slotRequests[slot].clear = false;
+    }
+
+    notify();
+}
+
+void KernelDesigner::clearPrecomputed (int slot)
+{
+    jassert (slot >= 0 && slot < maxPrecomputed);
+
+    {
+        const ScopedLock sl (slotLock);
+        slotRequests[slot].pending = true;
+        slotRequests[slot].clear = true;
+    }
+
+    notify();
+}
+
+const EQKernelSet* KernelDesigner::takePrecomputed (const KernelSettings& settings)
+{
+    const EQKernelSet* found = nullptr;
+    precomputedReaders.fetch_add (1);
+
+    for (int i = 0; i < maxPrecomputed && found == nullptr; i++)
+    {
+        const EQKernelSet* kernelSet = precomputedKernels[i].load();
+        if (kernelSet != nullptr && kernelSet->settings == settings)
+        {
+            KernelCache::addReference (kernelSet);
+            found = kernelSet;
+        }
+    }
+
+    precomputedReaders.fetch_add (1);
+    return found;
+}
+
+bool KernelDesigner::precomputeNext()
+{
+    int slot = -1;
+    SlotRequest request;
+    {
+        const ScopedLock sl (slotLock);
+        for (int i = 0; i < maxPrecomputed && slot < 0; i++)
+        {
+            if (slotRequests[i].pending)
+            {
+                slot = i;
+                request = slotRequests[i];
+                slotRequests[i].pending = false;
+            }
+        }
+    }
+
+    if (slot < 0)
+        return false;
+
+    const EQKernelSet* kernelSet = request.clear ? nullptr : kernelCache->acquire (request.settings);
+    const EQKernelSet* previous = precomputedKernels[slot].exchange (kernelSet);
+
+    if (previous != nullptr)
+    {
+        // The audio thread may have loaded the old set and not taken its reference yet.
+        // It only does that between the two steps of precomputedReaders, so wait for it.
+        const uint32 readers = precomputedReaders.load();
+        if ((readers & 1) != 0)
+            while (precomputedReaders.load() == readers)
+                Thread::yield();
+
+        kernelCache->release (previous);
+    }
+
+    return true;
+}
+
+void KernelDesigner::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (pollIntervalMs);
+
+        // Keep going while there is work, the audio thread's request first each time
+        // round so it never waits behind a batch of slots. A burst of requests only
+        // gets designed once, for the latest settings.
+        for (;;)
+        {
+            releaseRetiredKernels();
+
+            if (threadShouldExit())
+                return;
+
+            if (designRequested.exchange (false))
+                publish (kernelCache->acquire (readRequest()));
+            else if (! precomputeNext())
+                break;
+        }
+    }
+}
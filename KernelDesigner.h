@@ -0,0 +1,261 @@
+// This is the header for the runtime FIR designer.
+// Band kernels are designed with a Kaiser windowed sinc for the host's
+// sample rate on a background thread, and finished kernel sets are handed
+// to the audio thread through a lock-free pointer swap, so design work
+// never runs inside the audio callback.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class KernelCache;
+
+// Everything a kernel set is designed for
+struct KernelSettings
+{
+    double sampleRate = 44100.0;
+    float lowCrossover = 500.0f;
+    float highCrossover = 4000.0f;
+    int length = 129;
+
+    // FFT partition size the spectra are computed for, 0 for direct form only
+    int partitionSize = 0;
+
+    // Whether the spectra are for the double precision convolver instead of the float one
+    bool doublePrecision = false;
+
+    // Whether the low band may move to the multirate path. Off when the bands are
+    // needed on their own, as the multirate low band only exists mixed into the mid.
+    bool allowMultirate = true;
+
+    bool operator== (const KernelSettings& other) const
+    {
+        return sampleRate == other.sampleRate
+            && lowCrossover == other.lowCrossover
+            && highCrossover == other.highCrossover
+            && length == other.length
+            && partitionSize == other.partitionSize
+            && doublePrecision == other.doublePrecision
+            && allowMultirate == other.allowMultirate;
+    }
+
+    bool operator!= (const KernelSettings& other) const { return ! operator== (other); }
+};
+
+// Low band that runs at a fraction of the sample rate. The input is delayed, decimated
+// through the resampler lowpass, filtered by the low rate kernel and interpolated back
+// through the same lowpass, so it lands at the same delay as the full rate kernels.
+struct MultirateLowBand
+{
+    // 0 when the low band is part of the full rate kernels
+    int decimation = 0;
+
+    // Full rate samples of extra delay in front of the decimator
+    int delay = 0;
+
+    // Anti-aliasing lowpass at half the decimated rate, one channel
+    AudioBuffer<float> resampler;
+
+    // Low band kernel at the decimated rate, one channel
+    AudioBuffer<float> lowpass;
+
+    // Polyphase interpolator, one channel per phase, with the decimation gain folded in
+    AudioBuffer<float> phases;
+
+    // True if the other band can be crossfaded with this one, sharing its filter state
+    bool hasSameStructure (const MultirateLowBand& other) const
+    {
+        return decimation == other.decimation
+            && delay == other.delay
+            && resampler.getNumSamples() == other.resampler.getNumSamples()
+            && lowpass.getNumSamples() == other.lowpass.getNumSamples();
+    }
+};
+
+// Immutable set of low, mid and high band kernels. Once published it is only read.
+// All of its coefficients live in one allocation, see allocate().
+struct EQKernelSet
+{
+    KernelSettings settings;
+
+    // True if the bands were designed from the settings alone, so every instance at
+    // these settings can share the set. Sets built from hand made bands are never shared.
+    bool designed = false;
+
+    // Holders of the set, counted by KernelCache, which deletes it when this drops to 0
+    mutable std::atomic<int> references { 0 };
+
+    // Time domain kernels, one channel per band
+    AudioBuffer<float> bands;
+
+    // Taps outside [firstTap, firstTap + numTaps) are zero in every band and can be skipped
+    int firstTap = 0;
+    int numTaps = 0;
+
+    // With multirate.decimation above 0 the lo band kernel is empty and the mid band
+    // kernel passes the low band as well, the multirate path adds the difference
+    MultirateLowBand multirate;
+
+    // Partitioned spectra of each band for the FFT convolver, in the precision the settings
+    // ask for. The other precision's pointer is nullptr, and both are in direct form.
+    int numPartitions = 0;
+    int spectrumSize = 0;
+    float* spectra = nullptr;
+    double* doubleSpectra = nullptr;
+
+    // The spectra of a band in one precision, or nullptr if the set has none in it
+    template <typename FloatType>
+    const FloatType* getSpectra (int band) const;
+
+    // Sizes of the buffers a set holds, with 0 for the ones it doesn't have
+    struct Layout
+    {
+        int length = 0;
+        int numPartitions = 0;
+        int spectrumSize = 0;
+        bool doubleSpectra = false;
+        int decimation = 0;
+        int resamplerLength = 0;
+        int lowRateLength = 0;
+        int phaseLength = 0;
+    };
+
+    // Sets up bands, spectra and the multirate buffers in one zeroed allocation aligned
+    // to a cache line, with every channel starting on a line of its own. Instances that
+    // share the set then share those lines too, and no two sets share a line.
+    void allocate (const Layout& layout);
+
+    const static int cacheLineSize = 64;
+
+private:
+    HeapBlock<char> storage;
+};
+
+template <>
+inline const float* EQKernelSet::getSpectra<float> (int band) const
+{
+    return spectra != nullptr ? spectra + band * numPartitions * spectrumSize : nullptr;
+}
+
+template <>
+inline const double* EQKernelSet::getSpectra<double> (int band) const
+{
+    return doubleSpectra != nullptr ? doubleSpectra + band * numPartitions * spectrumSize : nullptr;
+}
+
+class KernelDesigner : private Thread
+{
+public:
+    KernelDesigner();
+    ~KernelDesigner();
+
+    // Designs a kernel set on the calling thread. The low band is a lowpass at the
+    // low crossover, the high band is a highpass at the high crossover and the mid
+    // band is what's left, so the three bands always sum back to a pure delay.
+    // At high sample rates long kernels move the low band to the multirate path.
+    static EQKernelSet* design (const KernelSettings& settings);
+
+    // Limits of the multirate low band. The decimation only depends on the sample
+    // rate, so it stays the same however the crossovers move.
+    static const int minDecimation = 8;
+    static const int maxDecimation = 32;
+    static const int maxPhaseLength = 16;
+
+    // Builds a kernel set from existing band kernels on the calling thread
+    static EQKernelSet* createFromBands (const float* lo, const float* mid, const float* hi,
+                                         int length, const KernelSettings& settings);
+
+    // Asks for a new design. Returns straight away and is safe to call from the audio
+    // thread, the design runs on the background thread and is then published.
+    // The thread picks the request up within pollIntervalMs. Only one thread may
+    // make requests, which is the audio thread.
+    void requestDesign (const KernelSettings& settings);
+
+    // Hands a set from the cache to the audio thread, along with a reference to it,
+    // replacing one it hasn't picked up yet. Not the audio thread.
+    void publish (const EQKernelSet* kernelSet);
+
+    // Audio thread: returns the latest published set, or nullptr if there is none.
+    // The caller then holds its reference and gives it back through retire() when done.
+    const EQKernelSet* getNewKernels();
+
+    // Audio thread: true if there is room to retire another set
+    bool canRetire() const { return retiredFifo.getFreeSpace() > 0; }
+
+    // Audio thread: gives back the reference to a set that is no longer used. It is
+    // released to the cache on the background thread, which may then delete it.
+    void retire (const EQKernelSet* kernelSet);
+
+    // Asks for a set to be designed ahead of time and kept in a slot, replacing the one
+    // there, so the audio thread can switch to it without waiting. The thread gets to
+    // slots once the audio thread's own requests are done. Not the audio thread.
+    void requestPrecomputed (int slot, const KernelSettings& settings);
+
+    // Empties a slot. This goes through the same requests, so an older one can't refill it.
+    void clearPrecomputed (int slot);
+
+    // Audio thread: returns the set in a slot made for these settings, with a reference
+    // taken for the caller, or nullptr if no slot has one
+    const EQKernelSet* takePrecomputed (const KernelSettings& settings);
+
+    const static int maxPrecomputed = 16;
+
+private:
+    void run() override;
+
+    // How often the thread looks for requests and retired sets. The audio thread
+    // doesn't signal it, as waking a thread takes a lock.
+    const static int pollIntervalMs = 10;
+
+    // Releases the sets the audio thread has retired
+    void releaseRetiredKernels();
+
+    // Reads the latest request as a whole, never a mix of two
+    KernelSettings readRequest() const;
+
+    // Designs the next slot that has been asked for, or returns false if there are none
+    bool precomputeNext();
+
+    // Designed sets go through the cache, so instances at the same settings share them
+    SharedResourcePointer<KernelCache> kernelCache;
+
+    // Latest requested settings, written by requestDesign on the audio thread. The fields
+    // are a seqlock: requestSequence is odd while a write is under way and moves on with
+    // every write, so the background thread retries any read that overlapped one.
+    std::atomic<uint32> requestSequence { 0 };
+    std::atomic<double> requestedSampleRate;
+    std::atomic<float> requestedLowCrossover;
+    std::atomic<float> requestedHighCrossover;
+    std::atomic<int> requestedLength;
+    std::atomic<int> requestedPartitionSize;
+    std::atomic<bool> requestedDoublePrecision;
+    std::atomic<bool> requestedAllowMultirate;
+    std::atomic<bool> designRequested;
+
+    // Set waiting to be picked up by the audio thread
+    std::atomic<const EQKernelSet*> pendingKernels;
+
+    // Sets retired by the audio thread, waiting to be released
+    const static int retiredCapacity = 16;
+    AbstractFifo retiredFifo;
+    const EQKernelSet* retiredKernels[retiredCapacity];
+
+    // Slot requests, made on the message thread. The lock is only shared with the
+    // background thread, the audio thread never takes it.
+    struct SlotRequest
+    {
+        KernelSettings settings;
+        bool pending = false;
+        bool clear = false;
+    };
+    CriticalSection slotLock;
+    SlotRequest slotRequests[maxPrecomputed];
+
+    // Sets designed ahead of time, each holding a reference. precomputedReaders is odd
+    // while the audio thread looks through them, and the background thread waits for it
+    // to move on before releasing a set it has replaced there.
+    std::atomic<const EQKernelSet*> precomputedKernels[maxPrecomputed];
+    std::atomic<uint32> precomputedReaders { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (KernelDesigner)
+};
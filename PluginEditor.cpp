@@ -7,10 +7,13 @@
 
 //==============================================================================
 ParametricEqAudioProcessorEditor::ParametricEqAudioProcessorEditor (ParametricEqAudioProcessor& p)
-    : AudioProcessorEditor (&p), processor (p)
+    : AudioProcessorEditor (&p), processor (p), mSpectrumAnalyser (p.getSpectrumFeed())
+   #if EQ_TELEMETRY
+    , mTelemetryDisplay (p.getTelemetry())
+   #endif
 {
     // Size of plugin window
-    setSize (600, 250);
+    setSize (600, 460);
     
     auto& params = processor.getParameters();
     
@@ -25,7 +28,7 @@ ParametricEqAudioProcessorEditor::ParametricEqAudioProcessorEditor (ParametricEq
     mLoGainControlSlider.setTextValueSuffix ("\n200Hz");
     mLoGainControlSlider.setRange(loGainParameter->range.start, loGainParameter->range.end, .01);
     mLoGainControlSlider.setValue(*loGainParameter);
-    mLoGainControlSlider.onValueChange = [this, loGainParameter]{*loGainParameter = mLoGainControlSlider.getValue();};
+    mLoGainControlSlider.onValueChange = [this, loGainParameter]{*loGainParameter = mLoGainControlSlider.getValue(); updateResponseCurve();};
     mLoGainControlSlider.onDragStart = [loGainParameter]{loGainParameter->beginChangeGesture();};
     mLoGainControlSlider.onDragEnd = [loGainParameter]{loGainParameter->endChangeGesture();};
     
@@ -39,7 +42,7 @@ ParametricEqAudioProcessorEditor::ParametricEqAudioProcessorEditor (ParametricEq
     mMidGainControlSlider.setTextValueSuffix ("\n2kHz");
     mMidGainControlSlider.setRange(midGainParameter->range.start, midGainParameter->range.end, .01);
     mMidGainControlSlider.setValue(*midGainParameter);
-    mMidGainControlSlider.onValueChange = [this, midGainParameter]{*midGainParameter = mMidGainControlSlider.getValue();};
+    mMidGainControlSlider.onValueChange = [this, midGainParameter]{*midGainParameter = mMidGainControlSlider.getValue(); updateResponseCurve();};
     mMidGainControlSlider.onDragStart = [midGainParameter]{midGainParameter->beginChangeGesture();};
     mMidGainControlSlider.onDragEnd = [midGainParameter]{midGainParameter->endChangeGesture();};
     
@@ -53,7 +56,7 @@ ParametricEqAudioProcessorEditor::ParametricEqAudioProcessorEditor (ParametricEq
     mHiGainControlSlider.setTextValueSuffix ("\n6kHz");
     mHiGainControlSlider.setRange(hiGainParameter->range.start, hiGainParameter->range.end, .01);
     mHiGainControlSlider.setValue(*hiGainParameter);
-    mHiGainControlSlider.onValueChange = [this, hiGainParameter]{*hiGainParameter = mHiGainControlSlider.getValue();};
+    mHiGainControlSlider.onValueChange = [this, hiGainParameter]{*hiGainParameter = mHiGainControlSlider.getValue(); updateResponseCurve();};
     mHiGainControlSlider.onDragStart = [hiGainParameter]{hiGainParameter->beginChangeGesture();};
     mHiGainControlSlider.onDragEnd = [hiGainParameter]{hiGainParameter->endChangeGesture();};
     
@@ -61,9 +64,86 @@ ParametricEqAudioProcessorEditor::ParametricEqAudioProcessorEditor (ParametricEq
     addAndMakeVisible(mLoGainControlSlider);
     addAndMakeVisible(mMidGainControlSlider);
     addAndMakeVisible(mHiGainControlSlider);
+    
+    // Spectrum display below the sliders
+    mSpectrumAnalyser.setBounds(10, 210, 580, 160);
+    addAndMakeVisible(mSpectrumAnalyser);
+    
+    // Response curve on top of the spectrum, drawn whenever a gain or crossover changes
+    mResponseCurve.setBounds(10, 210, 580, 160);
+    addAndMakeVisible(mResponseCurve);
+    updateResponseCurve();
+    
+   #if EQ_TELEMETRY
+    // Telemetry line below the spectrum
+    mTelemetryDisplay.setBounds(10, 376, 580, 24);
+    addAndMakeVisible(mTelemetryDisplay);
+   #endif
+    
+    // Preset menu, item IDs start at 1 because 0 means nothing selected
+    for(int i=0; i<processor.getNumPrograms(); i++)
+        mPresetBox.addItem(processor.getProgramName(i), i + 1);
+    mPresetBox.setSelectedId(processor.getCurrentProgram() + 1, dontSendNotification);
+    mPresetBox.setBounds(10, 404, 200, 24);
+    mPresetBox.onChange = [this]
+    {
+        processor.setCurrentProgram(mPresetBox.getSelectedId() - 1);
+        processor.updateHostDisplay();
+        updateSliders();
+    };
+    addAndMakeVisible(mPresetBox);
+    
+    // A/B button, the label shows which snapshot is live
+    mABButton.setButtonText(processor.isShowingB() ? "B" : "A");
+    mABButton.setBounds(220, 404, 60, 24);
+    mABButton.onClick = [this]
+    {
+        processor.toggleAB();
+        mABButton.setButtonText(processor.isShowingB() ? "B" : "A");
+        updateSliders();
+    };
+    addAndMakeVisible(mABButton);
+    
+    // host automation moves the sliders and the curve
+    for(auto* param : params)
+        param->addListener(this);
+}
+
+ParametricEqAudioProcessorEditor::~ParametricEqAudioProcessorEditor()
+{
+    for(auto* param : processor.getParameters())
+        param->removeListener(this);
+    cancelPendingUpdate();
+}
+
+void ParametricEqAudioProcessorEditor::updateSliders()
+{
+    // the parameters are already set, so the sliders mustn't write them back
+    auto& params = processor.getParameters();
+    mLoGainControlSlider.setValue(*(AudioParameterFloat*) params.getUnchecked(0), dontSendNotification);
+    mMidGainControlSlider.setValue(*(AudioParameterFloat*) params.getUnchecked(1), dontSendNotification);
+    mHiGainControlSlider.setValue(*(AudioParameterFloat*) params.getUnchecked(2), dontSendNotification);
+    updateResponseCurve();
+}
+
+void ParametricEqAudioProcessorEditor::updateResponseCurve()
+{
+    auto& params = processor.getParameters();
+    mResponseCurve.update(processor.getRequestedSettings(),
+                          *(AudioParameterFloat*) params.getUnchecked(0),
+                          *(AudioParameterFloat*) params.getUnchecked(1),
+                          *(AudioParameterFloat*) params.getUnchecked(2));
 }
 
-ParametricEqAudioProcessorEditor::~ParametricEqAudioProcessorEditor(){}
+void ParametricEqAudioProcessorEditor::parameterValueChanged(int, float)
+{
+    triggerAsyncUpdate();
+}
+
+void ParametricEqAudioProcessorEditor::handleAsyncUpdate()
+{
+    updateSliders();
+}
 
 //==============================================================================
 void ParametricEqAudioProcessorEditor::paint (Graphics& g)
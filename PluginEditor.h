@@ -4,12 +4,17 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginProcessor.h"
+#include "SpectrumAnalyser.h"
+#include "ResponseCurve.h"
+#include "TelemetryDisplay.h"
 
 //==============================================================================
 /**
 */
 
-class ParametricEqAudioProcessorEditor  : public AudioProcessorEditor
+class ParametricEqAudioProcessorEditor  : public AudioProcessorEditor,
+                                          private AudioProcessorParameter::Listener,
+                                          private AsyncUpdater
 {
 public:
     ParametricEqAudioProcessorEditor (ParametricEqAudioProcessor&);
@@ -18,13 +23,44 @@ public:
     //==============================================================================
     void paint (Graphics&) override;
     void resized() override;
+    
+    // Redraws the response curve for a new sample rate. Safe from any thread.
+    void sampleRateChanged() { triggerAsyncUpdate(); }
 
 private:
+    // Moves the sliders to the processor's parameters after a preset or A/B switch
+    void updateSliders();
+    
+    // Asks the response curve for the current gains and kernel settings.
+    // It only redraws if one of them has actually changed.
+    void updateResponseCurve();
+    
+    // Host automation can arrive on any thread, so it is passed on to the message thread
+    void parameterValueChanged(int parameterIndex, float newValue) override;
+    void parameterGestureChanged(int, bool) override {}
+    void handleAsyncUpdate() override;
+    
+
     ParametricEqAudioProcessor& processor;
     
     Slider mHiGainControlSlider;
     Slider mMidGainControlSlider;
     Slider mLoGainControlSlider;
+    
+    // Factory preset menu and A/B comparison
+    ComboBox mPresetBox;
+    TextButton mABButton;
+    
+    // Spectrum of the input and output, fed by the processor while the editor is open
+    SpectrumAnalyser mSpectrumAnalyser;
+    
+    // Response of the EQ, drawn over the spectrum
+    ResponseCurve mResponseCurve;
+    
+   #if EQ_TELEMETRY
+    // DSP load and deadline misses of processBlock
+    TelemetryDisplay mTelemetryDisplay;
+   #endif
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParametricEqAudioProcessorEditor)
 };
@@ -1,10 +1,45 @@
 // This file contains the code for the JUCE plugin processor.
-// 3 Band stereo filtering is implemented in the JUCE callback,
+// 3 Band filtering of up to 16 channels is implemented in the JUCE callback,
 // using a cascading filter design and a convolution utility function.
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    // Kernel lengths offered by the length parameter, all odd so the kernels stay
+    // symmetric around a whole sample. 257 and up run by FFT convolution, 1025 and up
+    // in double precision, unless the designer moves the low band to the multirate path.
+    const int kernelLengths[] = { 33, 41, 65, 129, 257, 513, 1025, 2049, 4097 };
+    const int numKernelLengths = sizeof(kernelLengths) / sizeof(kernelLengths[0]);
+    const int defaultKernelLength = 3;
+    
+    // Choices of the mode parameter
+    const int linearPhaseMode = 0;
+    const int lowLatencyMode = 1;
+    
+    // Magic number ("PEQS") and layout version of the saved state. Later versions
+    // only ever append fields, so older builds can still read what they know.
+    const int stateMagic = 0x50455153;
+    const int stateVersion = 1;
+    const int stateVersion1Size = 2*4 + 5*4 + 3;
+    
+    // Longest low rate kernel the designer can make out of MAX_KERNEL_LENGTH
+    const int maxLowRateLength = MAX_KERNEL_LENGTH / KernelDesigner::minDecimation + 1;
+    
+    // Input below this (about -120 dB) counts as silence
+    const float silenceThreshold = 1.0e-6f;
+    
+    // Cycles of the low crossover the IIR filters take to ring down below the silence threshold
+    const double iirTailCycles = 8.0;
+    
+    // Largest error per tap for a combined kernel to still count as a unit impulse
+    const float unityTolerance = 1.0e-6f;
+    
+    // How often the message thread looks for a latency change to report to the host
+    const int latencyPollIntervalMs = 50;
+}
+
 //==============================================================================
 ParametricEqAudioProcessor::ParametricEqAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -14,6 +49,9 @@ ParametricEqAudioProcessor::ParametricEqAudioProcessor()
                        .withInput  ("Input",  AudioChannelSet::stereo(), true)
                       #endif
                        .withOutput ("Output", AudioChannelSet::stereo(), true)
+                       .withOutput ("Low",    AudioChannelSet::stereo(), false)
+                       .withOutput ("Mid",    AudioChannelSet::stereo(), false)
+                       .withOutput ("High",   AudioChannelSet::stereo(), false)
                      #endif
                        )
 #endif
@@ -23,15 +61,171 @@ ParametricEqAudioProcessor::ParametricEqAudioProcessor()
     addParameter(mMidGainParameter = new AudioParameterFloat("midgain", "Mid Gain", 0, 1.5, 1));
     addParameter(mHiGainParameter = new AudioParameterFloat("higain", "High Gain", 0, 1.5, 1));
     
-    // initialize state to zero
-    for(int i=0; i<MAX_COEF; i++)
+    // crossover frequencies and kernel length for the runtime designer
+    addParameter(mLowCrossoverParameter = new AudioParameterFloat("lowfreq", "Low Crossover", NormalisableRange<float>(40, 1000, 1, 0.5), 500));
+    addParameter(mHighCrossoverParameter = new AudioParameterFloat("highfreq", "High Crossover", NormalisableRange<float>(1000, 16000, 1, 0.5), 4000));
+    
+    StringArray lengthChoices;
+    for(int i=0; i<numKernelLengths; i++)
+        lengthChoices.add(String(kernelLengths[i]) + " taps");
+    addParameter(mKernelLengthParameter = new AudioParameterChoice("kernellength", "Kernel Length", lengthChoices, defaultKernelLength));
+    
+    // linear phase FIR, or the IIR crossover for live monitoring
+    StringArray modeChoices;
+    modeChoices.add("Linear Phase");
+    modeChoices.add("Low Latency");
+    addParameter(mModeParameter = new AudioParameterChoice("mode", "Mode", modeChoices, linearPhaseMode));
+    
+    // load the classic band kernels with the initial gains, until
+    // prepareToPlay designs new ones for the host's sample rate
+    kernelLoGain = mLoGainParameter->get();
+    kernelMidGain = mMidGainParameter->get();
+    kernelHiGain = mHiGainParameter->get();
+    
+    float lo[ClassicKernels::length];
+    float mid[ClassicKernels::length];
+    float hi[ClassicKernels::length];
+    for(int i=0; i<ClassicKernels::length; i++)
     {
-        xStateL[i] = 0;
-        xStateR[i] = 0;
+        lo[i] = (float) ClassicKernels::lowPass[i];
+        mid[i] = (float) ClassicKernels::bandPass[i];
+        hi[i] = (float) ClassicKernels::hiPass[i];
     }
+    activeKernels = kernelCache->add(KernelDesigner::createFromBands(lo, mid, hi, ClassicKernels::length, KernelSettings()));
+    loadKernelStructure();
+    
+    startTimer(latencyPollIntervalMs);
 }
 
-ParametricEqAudioProcessor::~ParametricEqAudioProcessor(){}
+ParametricEqAudioProcessor::~ParametricEqAudioProcessor()
+{
+    stopTimer();
+    kernelCache->release(activeKernels);
+}
+
+//==============================================================================
+template <typename FloatType>
+ParametricEqAudioProcessor::FilterState<FloatType>::FilterState()
+{
+    // use the fastest FIR kernel this CPU supports
+    firProcess = FIRKernels::getBestProcessFunction<FloatType>();
+    kernelProcess[0] = kernelProcess[1] = firProcess;
+    bandProcess[0] = bandProcess[1] = firProcess;
+    
+    // kernel buffers are sized for the longest kernel and resampler up front,
+    // so loading new kernels never allocates on the audio thread
+    combinedKernels.setSize(2, MAX_KERNEL_LENGTH);
+    lowRateKernels.setSize(2, maxLowRateLength);
+    resampler.setSize(1, KernelDesigner::maxDecimation * KernelDesigner::maxPhaseLength);
+    phases.setSize(KernelDesigner::maxDecimation, KernelDesigner::maxPhaseLength);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::prepare(int numChannels, int samplesPerBlock, int fadeLength, bool bandOutputs)
+{
+    // Everything is sized for the longest kernel, so new kernels from
+    // the designer never need any allocation on the audio thread
+    delayLine.prepare(numChannels, MAX_KERNEL_LENGTH - 1, samplesPerBlock);
+    fadeBuffer.setSize(numChannels, samplesPerBlock);
+    bandKernels.setSize(bandOutputs && numChannels > 0 ? 6 : 0, MAX_KERNEL_LENGTH);
+    
+    // the multirate low band's buffers, history first then up to one chunk at the low rate
+    const int maxLowRateBlock = samplesPerBlock / KernelDesigner::minDecimation + 1;
+    lowRateInput.setSize(numChannels, maxLowRateLength + KernelDesigner::maxPhaseLength + maxLowRateBlock);
+    lowRateOutput.setSize(2 * numChannels, KernelDesigner::maxPhaseLength + maxLowRateBlock);
+    
+    fadeRamp.malloc(fadeLength);
+    for(int i=0; i<fadeLength; i++)
+        fadeRamp[i] = (FloatType)(i + 1) / fadeLength;
+    
+    iirCrossover.prepare(numChannels, samplesPerBlock);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::clear()
+{
+    delayLine.clear();
+    lowRateInput.clear();
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::clearChannel(int chan)
+{
+    delayLine.clearChannel(chan);
+    lowRateInput.clear(chan, 0, lowRateInput.getNumSamples());
+    lowRateOutput.clear(2*chan, 0, lowRateOutput.getNumSamples());
+    lowRateOutput.clear(2*chan + 1, 0, lowRateOutput.getNumSamples());
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::prepareConvolvers(int numChannels, int partitionSize, const int* bandChannels)
+{
+    fftConvolver.prepare(numChannels, partitionSize, MAX_KERNEL_LENGTH, 2);
+    for(int band=0; band<3; band++)
+        bandConvolvers[band].prepare(bandChannels[band] < 0 ? 0 : numChannels, partitionSize, MAX_KERNEL_LENGTH, 2);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::mixConvolverKernels(int slot, const EQKernelSet& kernels, const float* gains, const int* bandChannels)
+{
+    // the set only has spectra in the precision the host processes in
+    const FloatType* bands[3] = { kernels.getSpectra<FloatType>(0), kernels.getSpectra<FloatType>(1), kernels.getSpectra<FloatType>(2) };
+    if(bands[0] == nullptr)
+        return;
+    
+    fftConvolver.mixKernels(slot, bands, gains, 3, kernels.numPartitions);
+    for(int band=0; band<3; band++)
+        if(bandChannels[band] >= 0)
+            bandConvolvers[band].mixKernels(slot, bands + band, gains + band, 1, kernels.numPartitions);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::switchConvolvers(int slot, bool crossfade)
+{
+    if(! crossfade)
+        fftConvolver.reset();
+    fftConvolver.switchKernel(slot, crossfade);
+    
+    for(int band=0; band<3; band++)
+    {
+        if(! crossfade)
+            bandConvolvers[band].reset();
+        bandConvolvers[band].switchKernel(slot, crossfade);
+    }
+}
+
+template <typename FloatType>
+bool ParametricEqAudioProcessor::FilterState<FloatType>::isSwitchingConvolvers(bool bandSum) const
+{
+    return (bandSum ? bandConvolvers[0] : fftConvolver).isSwitchingKernel();
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::FilterState<FloatType>::loadResampler(const MultirateLowBand& multirate)
+{
+    // shrinks into the memory from the constructor, so this is safe on the audio thread
+    resampler.setSize(1, multirate.resampler.getNumSamples(), false, false, true);
+    phases.setSize(multirate.phases.getNumChannels(), multirate.phases.getNumSamples(), false, false, true);
+    
+    for(int i=0; i<resampler.getNumSamples(); i++)
+        resampler.setSample(0, i, multirate.resampler.getSample(0, i));
+    
+    for(int phase=0; phase<phases.getNumChannels(); phase++)
+        for(int i=0; i<phases.getNumSamples(); i++)
+            phases.setSample(phase, i, multirate.phases.getSample(phase, i));
+}
+
+template <>
+ParametricEqAudioProcessor::FilterState<float>& ParametricEqAudioProcessor::getState<float>()
+{
+    return floatState;
+}
+
+template <>
+ParametricEqAudioProcessor::FilterState<double>& ParametricEqAudioProcessor::getState<double>()
+{
+    return doubleState;
+}
 
 //==============================================================================
 const String ParametricEqAudioProcessor::getName() const
@@ -68,44 +262,140 @@ bool ParametricEqAudioProcessor::isMidiEffect() const
 
 double ParametricEqAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return tailSamples / currentSampleRate;
 }
 
 int ParametricEqAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return FactoryPresets::numPresets;
 }
 
 int ParametricEqAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void ParametricEqAudioProcessor::setCurrentProgram (int index)
 {
+    if(index < 0 || index >= FactoryPresets::numPresets)
+        return;
+    
+    // The preset's kernels were asked for in prepareToPlay and the audio thread fades to them.
+    // Asking again only designs anything if the kernel length has changed since.
+    const FactoryPresets::Preset& preset = FactoryPresets::presets[index];
+    const Snapshot snapshot = { preset.loGain, preset.midGain, preset.hiGain, preset.lowCrossover, preset.highCrossover };
+    currentProgram = index;
+    precomputeKernels(index, snapshot);
+    applySnapshot(snapshot);
 }
 
 const String ParametricEqAudioProcessor::getProgramName (int index)
 {
-    return {};
+    if(index < 0 || index >= FactoryPresets::numPresets)
+        return {};
+    
+    return FactoryPresets::presets[index].name;
 }
 
 void ParametricEqAudioProcessor::changeProgramName (int index, const String& newName)
 {
+    // factory presets keep their names
 }
 
 //==============================================================================
 void ParametricEqAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
+    currentSampleRate = sampleRate;
+    preparedBlockSize = samplesPerBlock;
+    numChannels = getMainBusNumOutputChannels();
+    useDoublePrecision = isUsingDoublePrecision();
+    
+    // the band output buses that are on, the layout check makes them the main bus's size
+    useBandOutputs = false;
+    for(int band=0; band<3; band++)
+    {
+        const Bus* bus = getBus(false, firstBandBus + band);
+        const bool enabled = bus != nullptr && bus->isEnabled();
+        bandChannels[band] = enabled ? getChannelIndexInProcessBlockBuffer(false, firstBandBus + band, 0) : -1;
+        useBandOutputs = useBandOutputs || enabled;
+    }
+    useBandSum = bandChannels[0] >= 0 && bandChannels[1] >= 0 && bandChannels[2] >= 0;
+    
+    // Gain ramps take the same time at any sample rate
+    fadeLength = jmax(1, roundToInt(fadeTimeSeconds * sampleRate));
+    fadeSamplesRemaining = 0;
+    
+    // only the precision the host processes in gets channel buffers
+    floatState.prepare(useDoublePrecision ? 0 : numChannels, samplesPerBlock, fadeLength, useBandOutputs);
+    doubleState.prepare(useDoublePrecision ? numChannels : 0, samplesPerBlock, fadeLength, useBandOutputs);
+    
+    // FFT partitions of about the host block size, so each block costs about one FFT per channel
+    partitionSize = jlimit(64, 4096, nextPowerOfTwo(samplesPerBlock));
+    floatState.prepareConvolvers(useDoublePrecision ? 0 : numChannels, partitionSize, bandChannels);
+    doubleState.prepareConvolvers(useDoublePrecision ? numChannels : 0, partitionSize, bandChannels);
+    
+    spectrumFeed.prepare(sampleRate);
+    
+    // the editor's response curve is drawn for the sample rate
+    if(auto* editor = dynamic_cast<ParametricEqAudioProcessorEditor*>(getActiveEditor()))
+        editor->sampleRateChanged();
+    
+    // every channel starts out active
+    silentSamples.calloc(numChannels);
+    channelIdle.calloc(numChannels);
+    
+   #if EQ_TELEMETRY
+    telemetry.prepare(sampleRate, samplesPerBlock);
+   #endif
+    
+    // The audio thread isn't running yet, so get kernels for this sample rate right
+    // here instead of on the designer thread. Other instances at the same settings
+    // have usually designed them already.
+    requestedSettings = getRequestedSettings();
+    kernelCache->release(activeKernels);
+    activeKernels = kernelCache->acquire(requestedSettings);
+    
+    // presets and A/B snapshots are designed on the designer thread while playback starts,
+    // the active set above is the only one this waits for
+    for(int i=0; i<FactoryPresets::numPresets; i++)
+    {
+        const FactoryPresets::Preset& preset = FactoryPresets::presets[i];
+        precomputeKernels(i, { preset.loGain, preset.midGain, preset.hiGain, preset.lowCrossover, preset.highCrossover });
+    }
+    if(abStored)
+    {
+        precomputeKernels(abSlot, abSnapshots[0]);
+        precomputeKernels(abSlot + 1, abSnapshots[1]);
+    }
+    kernelDesigner.clearPrecomputed(restoredSlot);
+    
+    kernelLoGain = mLoGainParameter->get();
+    kernelMidGain = mMidGainParameter->get();
+    kernelHiGain = mHiGainParameter->get();
+    loadKernelStructure();
+    
+    // the IIR crossover starts from the current parameters too
+    useIIRFilter = mModeParameter->getIndex() == lowLatencyMode;
+    resetIIRFilter();
+    
+    latencyToReport = useIIRFilter ? 0 : getFIRLatencySamples();
+    setLatencySamples(latencyToReport);
+    
+    // Wide buses get their channel groups spread across cores
+    int numWorkers = 0;
+    if(numChannels >= minChannelsForWorkers)
+    {
+        int numGroups = (numChannels + channelsPerGroup - 1) / channelsPerGroup;
+        numWorkers = jmin(numGroups - 1, SystemStats::getNumCpus() - 1);
+    }
+    workerPool.setNumWorkers(numWorkers);
 }
 
 void ParametricEqAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    workerPool.setNumWorkers(0);
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -116,9 +406,10 @@ bool ParametricEqAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
     return true;
   #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+    // Every channel is filtered the same way, so any layout from mono
+    // up to MAX_CHANNELS channels works.
+    if (layouts.getMainOutputChannelSet().isDisabled()
+     || layouts.getMainOutputChannelSet().size() > MAX_CHANNELS)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -127,44 +418,494 @@ bool ParametricEqAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
         return false;
    #endif
 
+    // The band outputs are either off or laid out like the main output
+    for (int bus = 1; bus < layouts.outputBuses.size(); bus++)
+        if (! layouts.getChannelSet (false, bus).isDisabled()
+         && layouts.getChannelSet (false, bus) != layouts.getMainOutputChannelSet())
+            return false;
+
     return true;
   #endif
 }
 #endif
 
-// Utility function for generic FIR filtering
-float ParametricEqAudioProcessor::filter(float* buffer, double* coeffs, int P, int n, int chan)
+void ParametricEqAudioProcessor::setBandKernels(const float* lo, const float* mid, const float* hi, int length)
 {
-    float sum;
-    // filter buffer
-    sum = 0;
-        for (int i=0; i<=P; i++)
+    jassert(length <= MAX_KERNEL_LENGTH);
+    
+    KernelSettings settings = requestedSettings;
+    settings.length = length;
+    settings.partitionSize = length >= getFFTKernelThreshold() ? partitionSize : 0;
+    settings.doublePrecision = useDoublePrecision && settings.partitionSize > 0;
+    kernelDesigner.publish(kernelCache->add(KernelDesigner::createFromBands(lo, mid, hi, length, settings)));
+}
+
+KernelSettings ParametricEqAudioProcessor::getRequestedSettings() const
+{
+    KernelSettings settings;
+    settings.sampleRate = currentSampleRate;
+    settings.lowCrossover = mLowCrossoverParameter->get();
+    settings.highCrossover = mHighCrossoverParameter->get();
+    settings.length = kernelLengths[mKernelLengthParameter->getIndex()];
+    settings.partitionSize = settings.length >= getFFTKernelThreshold() ? partitionSize : 0;
+    settings.doublePrecision = useDoublePrecision && settings.partitionSize > 0;
+    settings.allowMultirate = ! useBandOutputs;
+    return settings;
+}
+
+AudioParameterFloat* ParametricEqAudioProcessor::getFloatParameter(const String& paramID) const
+{
+    for(auto* parameter : { mLoGainParameter, mMidGainParameter, mHiGainParameter, mLowCrossoverParameter, mHighCrossoverParameter })
+        if(parameter->paramID == paramID)
+            return parameter;
+    
+    jassertfalse;
+    return nullptr;
+}
+
+AudioParameterChoice* ParametricEqAudioProcessor::getChoiceParameter(const String& paramID) const
+{
+    for(auto* parameter : { mKernelLengthParameter, mModeParameter })
+        if(parameter->paramID == paramID)
+            return parameter;
+    
+    jassertfalse;
+    return nullptr;
+}
+
+void ParametricEqAudioProcessor::adoptNewKernels()
+{
+    const EQKernelSet* newKernels = kernelDesigner.getNewKernels();
+    if(newKernels == nullptr)
+        return;
+    
+    // Drop sets designed for anything but the latest request: before the last prepareToPlay,
+    // for a length or partition size that has changed since, or with a multirate low band
+    // the band outputs can't use. Adopting one would reload the filter structure twice.
+    // Also drop designs for crossovers that have moved on since, a precomputed set may
+    // already have taken over and the designer is working on the next request anyway.
+    // Hand made sets from setBandKernels bring their own length and partition size.
+    const KernelSettings& settings = newKernels->settings;
+    KernelSettings expected = requestedSettings;
+    if(! newKernels->designed)
+    {
+        expected.length = settings.length;
+        expected.partitionSize = settings.partitionSize;
+        expected.doublePrecision = settings.doublePrecision;
+    }
+    
+    if(settings != expected)
+    {
+        kernelDesigner.retire(newKernels);
+        return;
+    }
+    
+    switchKernels(newKernels);
+}
+
+bool ParametricEqAudioProcessor::adoptPrecomputedKernels(const KernelSettings& settings)
+{
+    // the designer has to take the old set back, leave it to the designer if it can't
+    if(! kernelDesigner.canRetire())
+        return false;
+    
+    // the slot keeps its own reference, this one is for the active set
+    const EQKernelSet* kernels = kernelDesigner.takePrecomputed(settings);
+    if(kernels == nullptr)
+        return false;
+    
+    if(kernels == activeKernels)
+        kernelDesigner.retire(kernels);
+    else
+        switchKernels(kernels);
+    return true;
+}
+
+void ParametricEqAudioProcessor::switchKernels(const EQKernelSet* kernels)
+{
+    bool sameStructure = kernels->settings.length == kernelLength
+                         && kernels->multirate.hasSameStructure(activeKernels->multirate);
+    kernelDesigner.retire(activeKernels);
+    activeKernels = kernels;
+    
+    // Kernels of the same length crossfade like a gain change in updateCombinedKernel.
+    // A new length changes the latency, so there is nothing sensible to fade between.
+    // The multirate structure only depends on the sample rate and length, so designed
+    // sets always fade, only hand made ones can switch it at the same length.
+    if(! sameStructure)
+    {
+        loadKernelStructure();
+        latencyChanged = true;
+    }
+}
+
+void ParametricEqAudioProcessor::loadKernelStructure()
+{
+    kernelLength = activeKernels->settings.length;
+    const bool hasSpectra = useDoublePrecision ? activeKernels->getSpectra<double>(0) != nullptr
+                                               : activeKernels->getSpectra<float>(0) != nullptr;
+    useFFTConvolution = activeKernels->numTaps >= getFFTKernelThreshold() && hasSpectra;
+    useMultirate = activeKernels->multirate.decimation > 0;
+    
+    if(useMultirate)
+    {
+        floatState.loadResampler(activeKernels->multirate);
+        doubleState.loadResampler(activeKernels->multirate);
+    }
+    
+    fadeSamplesRemaining = 0;
+    buildCombinedKernel(0, kernelLoGain, kernelMidGain, kernelHiGain);
+    buildCombinedKernel(1, kernelLoGain, kernelMidGain, kernelHiGain);
+    kernelSource = activeKernels;
+    
+    if(useFFTConvolution)
+    {
+        floatState.switchConvolvers(currentKernel, false);
+        doubleState.switchConvolvers(currentKernel, false);
+    }
+    else
+    {
+        floatState.clear();
+        doubleState.clear();
+        sampleClock = 0;
+    }
+    
+    latencyToReport = getFIRLatencySamples();
+    updateTailLength();
+}
+
+int ParametricEqAudioProcessor::getFIRLatencySamples() const
+{
+    // Linear phase kernels delay everything by half their length, and
+    // overlap-save needs a full partition of input before it can output anything
+    return (kernelLength - 1) / 2 + (useFFTConvolution ? partitionSize : 0);
+}
+
+void ParametricEqAudioProcessor::updateTailLength()
+{
+    if(useIIRFilter)
+    {
+        // the crossover filters ring longest at the low crossover
+        tailSamples = roundToInt(iirTailCycles * currentSampleRate / jmax(10.0f, iirLowCrossover));
+        return;
+    }
+    
+    // the full impulse response, and the multirate low band reaches back through both resamplers
+    int length = kernelLength - 1;
+    if(useMultirate)
+    {
+        const MultirateLowBand& multirate = activeKernels->multirate;
+        length = jmax(length, multirate.delay + multirate.resampler.getNumSamples()
+                              + multirate.decimation*(multirate.lowpass.getNumSamples() + multirate.phases.getNumSamples()));
+    }
+    
+    tailSamples = length + (useFFTConvolution ? partitionSize : 0);
+}
+
+void ParametricEqAudioProcessor::updateFilterMode()
+{
+    const bool iir = mModeParameter->getIndex() == lowLatencyMode;
+    if(iir == useIIRFilter)
+        return;
+    
+    useIIRFilter = iir;
+    
+    if(useIIRFilter)
+    {
+        fadeSamplesRemaining = 0;
+        resetIIRFilter();
+        latencyToReport = 0;
+    }
+    else
+    {
+        // start the kernels from the current gains, a pending design fades in as usual
+        kernelLoGain = mLoGainParameter->get();
+        kernelMidGain = mMidGainParameter->get();
+        kernelHiGain = mHiGainParameter->get();
+        loadKernelStructure();
+    }
+    
+    latencyChanged = true;
+}
+
+void ParametricEqAudioProcessor::resetIIRFilter()
+{
+    iirLowCrossover = mLowCrossoverParameter->get();
+    iirHighCrossover = mHighCrossoverParameter->get();
+    iirLoGain = mLoGainParameter->get();
+    iirMidGain = mMidGainParameter->get();
+    iirHiGain = mHiGainParameter->get();
+    
+    // both precisions, they're cheap to keep in step and only one has any channels
+    floatState.iirCrossover.reset();
+    floatState.iirCrossover.setCrossovers(currentSampleRate, iirLowCrossover, iirHighCrossover);
+    floatState.iirCrossover.setGains(iirLoGain, iirMidGain, iirHiGain, 0);
+    doubleState.iirCrossover.reset();
+    doubleState.iirCrossover.setCrossovers(currentSampleRate, iirLowCrossover, iirHighCrossover);
+    doubleState.iirCrossover.setGains(iirLoGain, iirMidGain, iirHiGain, 0);
+    updateTailLength();
+}
+
+void ParametricEqAudioProcessor::updateIIRFilter()
+{
+    // one snapshot of the parameters per chunk, like the FIR mode
+    const float lowCrossover = mLowCrossoverParameter->get();
+    const float highCrossover = mHighCrossoverParameter->get();
+    const float loGain = mLoGainParameter->get();
+    const float midGain = mMidGainParameter->get();
+    const float hiGain = mHiGainParameter->get();
+    
+    // new coefficients are just a few trig calls, no designer thread needed
+    if(lowCrossover != iirLowCrossover || highCrossover != iirHighCrossover)
+    {
+        iirLowCrossover = lowCrossover;
+        iirHighCrossover = highCrossover;
+        floatState.iirCrossover.setCrossovers(currentSampleRate, lowCrossover, highCrossover);
+        doubleState.iirCrossover.setCrossovers(currentSampleRate, lowCrossover, highCrossover);
+        updateTailLength();
+    }
+    
+    if(loGain != iirLoGain || midGain != iirMidGain || hiGain != iirHiGain)
+    {
+        iirLoGain = loGain;
+        iirMidGain = midGain;
+        iirHiGain = hiGain;
+        floatState.iirCrossover.setGains(loGain, midGain, hiGain, fadeLength);
+        doubleState.iirCrossover.setGains(loGain, midGain, hiGain, fadeLength);
+    }
+}
+
+void ParametricEqAudioProcessor::timerCallback()
+{
+    if(latencyChanged.exchange(false))
+        setLatencySamples(latencyToReport);
+}
+
+void ParametricEqAudioProcessor::buildCombinedKernel(int slot, float loGain, float midGain, float hiGain)
+{
+    // both precisions, so the kernels are ready whichever one the host processes in
+    kernelIsDelay[slot] = buildCombinedKernel<float>(slot, loGain, midGain, hiGain);
+    buildCombinedKernel<double>(slot, loGain, midGain, hiGain);
+    kernelFirstTap[slot] = activeKernels->firstTap;
+    kernelNumTaps[slot] = activeKernels->numTaps;
+    selectKernelProcess(slot);
+    
+    // the spectra are linear in the gains too, so FFT mode needs no extra transforms
+    if(useFFTConvolution)
+    {
+        const float gains[3] = { loGain, midGain, hiGain };
+        floatState.mixConvolverKernels(slot, *activeKernels, gains, bandChannels);
+        doubleState.mixConvolverKernels(slot, *activeKernels, gains, bandChannels);
+    }
+}
+
+template <typename FloatType>
+bool ParametricEqAudioProcessor::buildCombinedKernel(int slot, float loGain, float midGain, float hiGain)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
+    FloatType* kernel = state.combinedKernels.getWritePointer(slot);
+    const float* lo = activeKernels->bands.getReadPointer(0);
+    const float* mid = activeKernels->bands.getReadPointer(1);
+    const float* hi = activeKernels->bands.getReadPointer(2);
+    const FloatType gains[3] = { loGain, midGain, hiGain };
+    
+    for(int i=0; i<kernelLength; i++)
+    {
+        kernel[i] = gains[0]*lo[i] + gains[1]*mid[i] + gains[2]*hi[i];
+    }
+    
+    // the band outputs run the same products separately
+    if(state.bandKernels.getNumChannels() > 0)
+    {
+        const float* bands[3] = { lo, mid, hi };
+        for(int band=0; band<3; band++)
         {
-            if((n-i) < 0)
-            {
-                // Determine whether we're filtering left or right channel
-                if(chan == 0)
-                {
-                    sum += xStateL[MAX_COEF+(n-i)]*coeffs[i];
-                }
-                else if(chan == 1)
-                {
-                    sum += xStateR[MAX_COEF+(n-i)]*coeffs[i];
-                }
-            }
-            else
-            {
-                sum += buffer[n-i]*coeffs[i];
-            }
+            FloatType* bandKernel = state.bandKernels.getWritePointer(3*slot + band);
+            for(int i=0; i<kernelLength; i++)
+                bandKernel[i] = gains[band]*bands[band][i];
         }
-    return sum;
+    }
+    
+    // the mid band kernel passes the low band too, so the multirate path only adds the difference
+    if(useMultirate)
+    {
+        const AudioBuffer<float>& lowpass = activeKernels->multirate.lowpass;
+        const float* low = lowpass.getReadPointer(0);
+        FloatType* lowKernel = state.lowRateKernels.getWritePointer(slot);
+        
+        for(int i=0; i<lowpass.getNumSamples(); i++)
+            lowKernel[i] = (gains[0] - gains[1])*low[i];
+    }
+    
+    // unity gains on designed kernels give a unit impulse at the centre, a plain delay
+    const int centre = kernelLength / 2;
+    bool isDelay = true;
+    for(int i=0; i<kernelLength && isDelay; i++)
+        isDelay = std::abs(kernel[i] - (i == centre ? 1 : 0)) < unityTolerance;
+    return isDelay;
+}
+
+void ParametricEqAudioProcessor::selectKernelProcess(int slot)
+{
+    selectKernelProcess<float>(slot);
+    selectKernelProcess<double>(slot);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::selectKernelProcess(int slot)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
+    const FloatType* kernel = state.combinedKernels.getReadPointer(slot) + kernelFirstTap[slot];
+    const int numTaps = kernelNumTaps[slot];
+    
+    // the designer's kernels are symmetric to the last bit, the classic ones aren't quite
+    bool isSymmetric = numTaps % 2 == 1;
+    for(int i=0; i<numTaps/2 && isSymmetric; i++)
+        isSymmetric = kernel[i] == kernel[numTaps - 1 - i];
+    
+    state.kernelProcess[slot] = isSymmetric ? FIRKernels::getSymmetricProcessFunction<FloatType>(numTaps) : state.firProcess;
+    
+    // the band kernels share one function, so all three have to be symmetric
+    if(state.bandKernels.getNumChannels() > 0)
+    {
+        bool bandsSymmetric = numTaps % 2 == 1;
+        for(int band=0; band<3 && bandsSymmetric; band++)
+        {
+            const FloatType* bandKernel = state.bandKernels.getReadPointer(3*slot + band) + kernelFirstTap[slot];
+            for(int i=0; i<numTaps/2 && bandsSymmetric; i++)
+                bandsSymmetric = bandKernel[i] == bandKernel[numTaps - 1 - i];
+        }
+        
+        state.bandProcess[slot] = bandsSymmetric ? FIRKernels::getSymmetricProcessFunction<FloatType>(numTaps) : state.firProcess;
+    }
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::retargetFade(float progress)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
+    FloatType* from = state.combinedKernels.getWritePointer(1 - currentKernel);
+    const FloatType* to = state.combinedKernels.getReadPointer(currentKernel);
+    
+    for(int i=0; i<kernelLength; i++)
+        from[i] += progress*(to[i] - from[i]);
+    
+    for(int band=0; state.bandKernels.getNumChannels() > 0 && band<3; band++)
+    {
+        FloatType* fromBand = state.bandKernels.getWritePointer(3*(1 - currentKernel) + band);
+        const FloatType* toBand = state.bandKernels.getReadPointer(3*currentKernel + band);
+        for(int i=0; i<kernelLength; i++)
+            fromBand[i] += progress*(toBand[i] - fromBand[i]);
+    }
+    
+    if(useMultirate)
+    {
+        FloatType* fromLow = state.lowRateKernels.getWritePointer(1 - currentKernel);
+        const FloatType* toLow = state.lowRateKernels.getReadPointer(currentKernel);
+        for(int i=0; i<activeKernels->multirate.lowpass.getNumSamples(); i++)
+            fromLow[i] += progress*(toLow[i] - fromLow[i]);
+    }
+}
+
+void ParametricEqAudioProcessor::updateCombinedKernel()
+{
+    // one snapshot of the parameters per chunk, nothing reads them per sample
+    const float loGain = mLoGainParameter->get();
+    const float midGain = mMidGainParameter->get();
+    const float hiGain = mHiGainParameter->get();
+    
+    // ask the designer for new kernels when the crossovers or the length have moved,
+    // and pick up whatever it has finished
+    KernelSettings settings = getRequestedSettings();
+    if(settings != requestedSettings)
+    {
+        requestedSettings = settings;
+        
+        // presets, A/B snapshots and restored states were designed ahead of time
+        if(! adoptPrecomputedKernels(settings))
+            kernelDesigner.requestDesign(settings);
+    }
+    adoptNewKernels();
+    
+    if(loGain == kernelLoGain && midGain == kernelMidGain && hiGain == kernelHiGain
+       && kernelSource == activeKernels)
+        return;
+    
+    // the FFT convolver finishes its switch within one partition, the new gains are picked up after that.
+    // The band convolvers all switch together, and stand in for it while the output is their sum.
+    if(useFFTConvolution && (floatState.isSwitchingConvolvers(useBandSum) || doubleState.isSwitchingConvolvers(useBandSum)))
+        return;
+    
+    if(! useFFTConvolution && fadeSamplesRemaining > 0)
+    {
+        // Retarget a ramp that is still running. The output so far has faded part of
+        // the way from the old kernel to the new one, and since the kernels are linear
+        // in the gains that point is itself a combined kernel. It becomes the start of
+        // a fresh ramp towards the new gains, so the gain curve stays continuous.
+        const float progress = (float)(fadeLength - fadeSamplesRemaining) / fadeLength;
+        retargetFade<float>(progress);
+        retargetFade<double>(progress);
+        
+        // which is non-zero wherever either of them is
+        const int firstTap = jmin(kernelFirstTap[0], kernelFirstTap[1]);
+        const int endTap = jmax(kernelFirstTap[0] + kernelNumTaps[0], kernelFirstTap[1] + kernelNumTaps[1]);
+        kernelFirstTap[1 - currentKernel] = firstTap;
+        kernelNumTaps[1 - currentKernel] = endTap - firstTap;
+        selectKernelProcess(1 - currentKernel);
+        
+        buildCombinedKernel(currentKernel, loGain, midGain, hiGain);
+    }
+    else
+    {
+        // build the new kernel in the spare slot, the old one stays around for the crossfade
+        currentKernel = 1 - currentKernel;
+        buildCombinedKernel(currentKernel, loGain, midGain, hiGain);
+    }
+    
+    kernelLoGain = loGain;
+    kernelMidGain = midGain;
+    kernelHiGain = hiGain;
+    kernelSource = activeKernels;
+    
+    // the FFT convolver crossfades by itself over its next partition
+    if(useFFTConvolution)
+    {
+        floatState.switchConvolvers(currentKernel, true);
+        doubleState.switchConvolvers(currentKernel, true);
+        return;
+    }
+    
+    fadeSamplesRemaining = fadeLength;
 }
 
 void ParametricEqAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
+{
+    jassert(! useDoublePrecision);
+    process(buffer);
+}
+
+void ParametricEqAudioProcessor::processBlock (AudioBuffer<double>& buffer, MidiBuffer& midiMessages)
+{
+    jassert(useDoublePrecision);
+    process(buffer);
+}
+
+bool ParametricEqAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::process(AudioBuffer<FloatType>& buffer)
 {
     ScopedNoDenormals noDenormals;
+    
+   #if EQ_TELEMETRY
+    BlockTelemetry::ScopedBlockTimer blockTimer(telemetry, buffer.getNumSamples());
+   #endif
+    
     auto totalNumInputChannels  = getTotalNumInputChannels();
-    auto totalNumOutputChannels = getTotalNumOutputChannels();
+    auto totalNumOutputChannels = getMainBusNumOutputChannels();
     
     // In case we have more outputs than inputs, this code clears any output
     // channels that didn't contain input data, (because these aren't
@@ -172,105 +913,378 @@ void ParametricEqAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiB
     // This is here to avoid people getting screaming feedback
     // when they first compile a plugin, but obviously you don't need to keep
     // this code if your algorithm always overwrites all the output channels.
+    // The band output buses are always written in full, so only the main bus is cleared.
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
     // number of samles in buffer
     int numSamp = buffer.getNumSamples();
     
-    // variables to keep track of each filter result
-    float sumLeftLow = 0;
-    float sumRightLow = 0;
-    float sumLeftMid = 0;
-    float sumRightMid = 0;
-    float sumLeftHi = 0;
-    float sumRightHi = 0;
-    
-    // arrays for keeping track of input and output
-    float yL1[numSamp];
-    float yR1[numSamp];
-    float xL[numSamp];
-    float xR[numSamp];
-
-    // copy buffer into x
-    for(int i=0; i<numSamp; i++)
+    // nothing has been allocated yet if the host skipped prepareToPlay
+    jassert(preparedBlockSize > 0);
+    if(preparedBlockSize == 0)
+    {
+        for(int i=totalNumOutputChannels; i<buffer.getNumChannels(); i++)
+            buffer.clear(i, 0, numSamp);
+        return;
+    }
+    
+    // All scratch memory is sized for the block size announced in prepareToPlay.
+    // Hosts may still send bigger blocks (offline bounces), so those are worked
+    // through in chunks instead of growing the buffers on the audio thread.
+    for(int start=0; start<numSamp; start+=preparedBlockSize)
+        processChunk(buffer, start, jmin(preparedBlockSize, numSamp - start));
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::processChunk(AudioBuffer<FloatType>& buffer, int startSample, int numSamp)
+{
+    // pick up any mode or gain change once per chunk, outside of the sample loop
+    updateFilterMode();
+    if(useIIRFilter)
+        updateIIRFilter();
+    else
+        updateCombinedKernel();
+    
+    // everything the channels share for this chunk
+    ChannelJob<FloatType> job;
+    job.processor = this;
+    job.buffer = &buffer;
+    job.numChannels = jmin(numChannels, buffer.getNumChannels());
+    job.startSample = startSample;
+    job.numSamp = numSamp;
+    job.fadeSamples = jmin(fadeSamplesRemaining, numSamp);
+    job.fadeOffset = fadeLength - fadeSamplesRemaining;
+    
+    // the spectrum display sees every chunk before and after filtering, while it's open
+    const bool feedSpectrum = spectrumFeed.isActive();
+    if(feedSpectrum)
+        spectrumFeed.push(SpectrumFeed::input, buffer, startSample, numSamp, job.numChannels);
+    
+    int numActive = 0;
+    for(int chan=0; chan<job.numChannels; chan++)
+        if(! updateChannelIdle<FloatType>(chan, buffer.getMagnitude(chan, startSample, numSamp), numSamp))
+            numActive++;
+    
+    // idle channels only clear their output, so there is no point waking the workers for them
+    if(workerPool.getNumWorkers() > 0 && numActive > 0)
+    {
+        int numGroups = (job.numChannels + channelsPerGroup - 1) / channelsPerGroup;
+        workerPool.run(processChannelGroup<FloatType>, &job, numGroups);
+    }
+    else if(useIIRFilter)
+    {
+        for(int first=0; first<job.numChannels; first+=channelsPerGroup)
+            filterIIR(buffer, first / channelsPerGroup, jmin(channelsPerGroup, job.numChannels - first), startSample, numSamp);
+    }
+    else
+    {
+        FloatType* bands[3];
+        for(int chan=0; chan<job.numChannels; chan++)
+            processChannel(chan, buffer.getWritePointer(chan, startSample), getBandOutputs(buffer, chan, startSample, bands),
+                           numSamp, job.fadeSamples, job.fadeOffset);
+    }
+    
+    if(feedSpectrum)
+        spectrumFeed.push(SpectrumFeed::output, buffer, startSample, numSamp, job.numChannels);
+    
+    fadeSamplesRemaining -= job.fadeSamples;
+    sampleClock += numSamp;
+}
+
+template <typename FloatType>
+bool ParametricEqAudioProcessor::updateChannelIdle(int chan, double inputLevel, int numSamp)
+{
+    // capped so a channel that stays silent for days doesn't overflow
+    if(inputLevel > silenceThreshold)
+        silentSamples[chan] = 0;
+    else
+        silentSamples[chan] = jmin(silentSamples[chan] + numSamp, 1 << 30);
+    
+    // The chunk's output depends on its own input and the tail before it. When all of
+    // that was silent, the filter state is cleared once and the channel outputs silence.
+    const bool idle = silentSamples[chan] >= tailSamples + numSamp;
+    if(idle && ! channelIdle[chan])
+        getState<FloatType>().clearChannel(chan);
+    
+    channelIdle[chan] = idle;
+    return idle;
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::processChannelGroup(void* context, int group)
+{
+    ChannelJob<FloatType>& job = *static_cast<ChannelJob<FloatType>*>(context);
+    int lastChannel = jmin(job.numChannels, (group + 1) * channelsPerGroup);
+    
+    if(job.processor->useIIRFilter)
+    {
+        job.processor->filterIIR(*job.buffer, group, lastChannel - group*channelsPerGroup, job.startSample, job.numSamp);
+        return;
+    }
+    
+    FloatType* bands[3];
+    for(int chan=group*channelsPerGroup; chan<lastChannel; chan++)
+        job.processor->processChannel(chan, job.buffer->getWritePointer(chan, job.startSample),
+                                      job.processor->getBandOutputs(*job.buffer, chan, job.startSample, bands),
+                                      job.numSamp, job.fadeSamples, job.fadeOffset);
+}
+
+template <typename FloatType>
+FloatType** ParametricEqAudioProcessor::getBandOutputs(AudioBuffer<FloatType>& buffer, int chan, int startSample, FloatType** bands) const
+{
+    if(! useBandOutputs)
+        return nullptr;
+    
+    // the band buses have the main bus's layout, so chan is there in each of them
+    for(int band=0; band<3; band++)
     {
-        xL[i] = buffer.getSample(0, i);
-        xR[i] = buffer.getSample(1, i);
+        jassert(bandChannels[band] + chan < buffer.getNumChannels());
+        bands[band] = bandChannels[band] < 0 ? nullptr : buffer.getWritePointer(bandChannels[band] + chan, startSample);
     }
+    return bands;
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::processChannel(int chan, FloatType* y, FloatType* const* bands, int numSamp, int fadeSamples, int fadeOffset)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
     
-    // filter signal
-    for(int n=0; n<numSamp; n++)
+    // Idle channels output silence. The FFT convolver is cleared every time,
+    // so a kernel switch made since doesn't wait for this channel.
+    if(channelIdle[chan])
     {
-        /***** Begin Left Channel Processing ****/
-        // Process low frequencies in left channel
-        sumLeftLow = 0;
-        // low pass left channel
-        sumLeftLow = filter(xL, lowPass, P, n, 0);
-        // User scaling of low frequencies in left channel
-        sumLeftLow *= mLoGainParameter->get();
+        FloatVectorOperations::clear(y, numSamp);
+        if(useFFTConvolution)
+            state.fftConvolver.resetChannel(chan);
         
-        // Process mid frequencies in left channel
-        sumLeftMid = 0;
-        // band pass left channel
-        sumLeftMid = filter(xL, bandPass, P, n, 0);
-        // User scaling of high frequencies in left channel
-        sumLeftMid *= mMidGainParameter->get();
+        for(int band=0; bands != nullptr && band<3; band++)
+        {
+            if(bands[band] == nullptr)
+                continue;
+            FloatVectorOperations::clear(bands[band], numSamp);
+            if(useFFTConvolution)
+                state.bandConvolvers[band].resetChannel(chan);
+        }
+        return;
+    }
+    
+    // Long kernels: partitioned FFT convolution, in place
+    if(useFFTConvolution)
+    {
+        processFFT(chan, y, bands, numSamp);
+        return;
+    }
+    
+    // append the new block to the delay line, the filter history is right behind it
+    const FloatType* x = state.delayLine.write(chan, y, numSamp);
+    
+    // the band outputs read the same history, the kernels are designed without the multirate path for them
+    if(bands != nullptr)
+    {
+        jassert(! useMultirate);
+        processBands(chan, x, bands, numSamp, fadeSamples, fadeOffset);
         
-        // Process high frequencies in left channel
-        sumLeftHi = 0;
-        // high pass left channel
-        sumLeftHi = filter(xL, hiPass, P2, n, 0);
-        //sumLeftHi = filterIIR(xL, hiPassA, hiPassB, A, B, n, 0);
-        // User scaling of high frequencies in left channel
-        sumLeftHi *= mHiGainParameter->get();
+        // the bands crossfade on their own, so their sum is the faded output too
+        if(useBandSum)
+        {
+            FloatVectorOperations::add(y, bands[0], bands[1], numSamp);
+            FloatVectorOperations::add(y, bands[2], numSamp);
+            return;
+        }
+    }
+    
+    // Unity gains: the kernel is a plain delay of half its length, so copy the input
+    // from that far back. The history stays up to date for when the gains move again.
+    if(fadeSamples == 0 && kernelIsDelay[currentKernel] && ! useMultirate)
+    {
+        FloatVectorOperations::copy(y, x - kernelLength / 2, numSamp);
+        return;
+    }
+    
+    // Low, mid and high bands in a single pass over the combined kernel, skipping its zero taps
+    const int first = kernelFirstTap[currentKernel];
+    state.kernelProcess[currentKernel](x - first, y, numSamp, state.combinedKernels.getReadPointer(currentKernel) + first, kernelNumTaps[currentKernel]);
+    
+    // Crossfade from the previous kernel while a gain change is in progress
+    if(fadeSamples > 0)
+    {
+        const int oldFirst = kernelFirstTap[1 - currentKernel];
+        FloatType* yOld = state.fadeBuffer.getWritePointer(chan);
+        state.kernelProcess[1 - currentKernel](x - oldFirst, yOld, fadeSamples, state.combinedKernels.getReadPointer(1 - currentKernel) + oldFirst, kernelNumTaps[1 - currentKernel]);
+        
+        // y = yOld + ramp*(y - yOld), in three vectorised passes
+        FloatVectorOperations::subtract(y, yOld, fadeSamples);
+        FloatVectorOperations::multiply(y, state.fadeRamp + fadeOffset, fadeSamples);
+        FloatVectorOperations::add(y, yOld, fadeSamples);
+    }
+    
+    // the low band runs decimated for long kernels at high sample rates
+    if(useMultirate)
+        addLowBand(chan, x, y, numSamp, fadeSamples, fadeOffset);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::processBands(int chan, const FloatType* x, FloatType* const* bands, int numSamp, int fadeSamples, int fadeOffset)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
+    const int first = kernelFirstTap[currentKernel];
+    const int oldFirst = kernelFirstTap[1 - currentKernel];
+    
+    for(int band=0; band<3; band++)
+    {
+        FloatType* y = bands[band];
+        if(y == nullptr)
+            continue;
         
-        // Sum low mid and high frequencies in left channel
-        yL1[n] = sumLeftLow + sumLeftMid + sumLeftHi;
-        /**** End Left Channel Processing ****/
+        state.bandProcess[currentKernel](x - first, y, numSamp, state.bandKernels.getReadPointer(3*currentKernel + band) + first, kernelNumTaps[currentKernel]);
         
+        // the same crossfade as the combined kernel, so the bands keep summing to the output
+        if(fadeSamples > 0)
+        {
+            FloatType* yOld = state.fadeBuffer.getWritePointer(chan);
+            state.bandProcess[1 - currentKernel](x - oldFirst, yOld, fadeSamples, state.bandKernels.getReadPointer(3*(1 - currentKernel) + band) + oldFirst, kernelNumTaps[1 - currentKernel]);
+            
+            FloatVectorOperations::subtract(y, yOld, fadeSamples);
+            FloatVectorOperations::multiply(y, state.fadeRamp + fadeOffset, fadeSamples);
+            FloatVectorOperations::add(y, yOld, fadeSamples);
+        }
+    }
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::processFFT(int chan, FloatType* y, FloatType* const* bands, int numSamp)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
+    
+    // the bands first, the output is convolved in place or summed from all three of them
+    for(int band=0; bands != nullptr && band<3; band++)
+        if(bands[band] != nullptr)
+            state.bandConvolvers[band].process(chan, y, bands[band], numSamp);
+    
+    if(useBandSum)
+    {
+        FloatVectorOperations::add(y, bands[0], bands[1], numSamp);
+        FloatVectorOperations::add(y, bands[2], numSamp);
+        return;
+    }
+    
+    state.fftConvolver.process(chan, y, y, numSamp);
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::addLowBand(int chan, const FloatType* x, FloatType* y, int numSamp, int fadeSamples, int fadeOffset)
+{
+    FilterState<FloatType>& state = getState<FloatType>();
+    const MultirateLowBand& multirate = activeKernels->multirate;
+    const int decimation = multirate.decimation;
+    const int resamplerLength = state.resampler.getNumSamples();
+    const int lowRateLength = multirate.lowpass.getNumSamples();
+    const int phaseLength = state.phases.getNumSamples();
+    
+    // the input keeps enough history to recompute phaseLength outputs of the low rate kernel
+    const int inputHistory = lowRateLength - 1 + phaseLength;
+    const int outputHistory = phaseLength;
+    
+    FloatType* v = state.lowRateInput.getWritePointer(chan);
+    FloatType* u[2] = { state.lowRateOutput.getWritePointer(2*chan), state.lowRateOutput.getWritePointer(2*chan + 1) };
+    const int oldKernel = 1 - currentKernel;
+    
+    // Both low rate kernels may have been rebuilt since the last fade, so their output
+    // history is recomputed from the decimated input, as if they had always been running
+    if(fadeSamples > 0 && fadeOffset == 0)
+    {
+        for(int slot=0; slot<2; slot++)
+            state.firProcess(v + inputHistory - phaseLength, u[slot], phaseLength, state.lowRateKernels.getReadPointer(slot), lowRateLength);
+    }
+    
+    // decimate at every multiple of the decimation on the shared sample clock
+    FloatType* vNew = v + inputHistory;
+    int numLowRate = 0;
+    for(int i=(int)((decimation - sampleClock % decimation) % decimation); i<numSamp; i+=decimation)
+        state.firProcess(x + i - multirate.delay, vNew + numLowRate++, 1, state.resampler.getReadPointer(0), resamplerLength);
+    
+    // low band at the low rate, for the old kernel too while fading
+    state.firProcess(vNew, u[currentKernel] + outputHistory, numLowRate, state.lowRateKernels.getReadPointer(currentKernel), lowRateLength);
+    if(fadeSamples > 0)
+        state.firProcess(vNew, u[oldKernel] + outputHistory, numLowRate, state.lowRateKernels.getReadPointer(oldKernel), lowRateLength);
+    
+    // interpolate back up, each output sample takes one polyphase branch of the resampler
+    const FloatType* uNew = u[currentKernel];
+    const FloatType* uOld = u[oldKernel];
+    int phase = (int)(sampleClock % decimation);
+    int latest = outputHistory - 1;
+    
+    for(int i=0; i<numSamp; i++)
+    {
+        if(phase == 0)
+            latest++;
         
-        /**** Begin Right Channel Processing ****/
-        // Process low frequencies in right channel
-        sumRightLow = 0;
-        // low pass right channel
-        sumRightLow = filter(xR, lowPass, P, n, 1);
-        // User scaling of low frequencies in right channel
-        sumRightLow *= mLoGainParameter->get();
+        const FloatType* taps = state.phases.getReadPointer(phase);
+        FloatType sum = 0;
+        for(int k=0; k<phaseLength; k++)
+            sum += taps[k]*uNew[latest - k];
         
-        // Process mid frequencies in right channel
-        sumRightMid = 0;
-        // band pass right channel
-        sumRightMid = filter(xR, bandPass, P, n, 1);
-        // User scaling of low frequencies in right channel
-        sumRightMid *= mMidGainParameter->get();
+        if(i < fadeSamples)
+        {
+            FloatType oldSum = 0;
+            for(int k=0; k<phaseLength; k++)
+                oldSum += taps[k]*uOld[latest - k];
+            
+            sum = oldSum + state.fadeRamp[fadeOffset + i]*(sum - oldSum);
+        }
         
-        // Process high frequencies in right channel
-        sumRightHi = 0;
-        // high pass right channel
-        sumRightHi = filter(xR, hiPass, P2, n, 1);
-        //sumLeftHi = filterIIR(xR, hiPassA, hiPassB, A, B, n, 1);
-        // User scaling of high frequencies in right channel
-        sumRightHi *= mHiGainParameter->get();
+        y[i] += sum;
         
-        // Sum low mid and high frequencies in right channel
-        yR1[n] = sumRightLow + sumRightMid + sumRightHi;
-        /**** End Right Channel Processing ****/
+        if(++phase == decimation)
+            phase = 0;
     }
     
-    // Coppy Y buffer into output buffer
-    for(int i=0; i<numSamp; i++)
+    // keep the last samples at both rates as history for the next chunk
+    memmove(v, v + numLowRate, inputHistory * sizeof(FloatType));
+    memmove(u[currentKernel], u[currentKernel] + numLowRate, outputHistory * sizeof(FloatType));
+    if(fadeSamples > 0)
+        memmove(u[oldKernel], u[oldKernel] + numLowRate, outputHistory * sizeof(FloatType));
+}
+
+template <typename FloatType>
+void ParametricEqAudioProcessor::filterIIR(AudioBuffer<FloatType>& buffer, int group, int numChans, int startSample, int numSamp)
+{
+    IIRCrossover<FloatType>& iirCrossover = getState<FloatType>().iirCrossover;
+    FloatType* channels[channelsPerGroup];
+    bool groupIdle = true;
+    for(int i=0; i<numChans; i++)
+    {
+        channels[i] = buffer.getWritePointer(group*channelsPerGroup + i, startSample);
+        groupIdle = groupIdle && channelIdle[group*channelsPerGroup + i];
+    }
+    
+    // the group's channels in each band output bus that is on
+    FloatType* bandChannelPointers[3][channelsPerGroup];
+    FloatType* const* bands[3] = { nullptr, nullptr, nullptr };
+    for(int band=0; band<3; band++)
     {
-        buffer.setSample(0, i, yL1[i]);
-        buffer.setSample(1, i, yR1[i]);
+        if(bandChannels[band] < 0)
+            continue;
+        for(int i=0; i<numChans; i++)
+            bandChannelPointers[band][i] = buffer.getWritePointer(bandChannels[band] + group*channelsPerGroup + i, startSample);
+        bands[band] = bandChannelPointers[band];
     }
     
-    // update state buffer
-    for(int i=0; i<=P; i++)
+    // the channels share their biquads, so a group only rests once all of them are idle
+    if(groupIdle)
     {
-        xStateL[MAX_COEF-P+i] = xL[numSamp-P+i];
-        xStateR[MAX_COEF-P+i] = xR[numSamp-P+i];
+        for(int i=0; i<numChans; i++)
+            FloatVectorOperations::clear(channels[i], numSamp);
+        for(int band=0; band<3; band++)
+            for(int i=0; bands[band] != nullptr && i<numChans; i++)
+                FloatVectorOperations::clear(bands[band][i], numSamp);
+        iirCrossover.resetGroup(group);
+        return;
     }
+    
+    // all channels of the group share each biquad, one SIMD lane each
+    iirCrossover.process(group, channels, numChans, numSamp, useBandOutputs ? bands : nullptr);
 }
 
 //==============================================================================
@@ -287,15 +1301,107 @@ AudioProcessorEditor* ParametricEqAudioProcessor::createEditor()
 //==============================================================================
 void ParametricEqAudioProcessor::getStateInformation (MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    MemoryOutputStream stream(destData, false);
+    stream.writeInt(stateMagic);
+    stream.writeInt(stateVersion);
+    
+    const Snapshot snapshot = getSnapshot();
+    stream.writeFloat(snapshot.loGain);
+    stream.writeFloat(snapshot.midGain);
+    stream.writeFloat(snapshot.hiGain);
+    stream.writeFloat(snapshot.lowCrossover);
+    stream.writeFloat(snapshot.highCrossover);
+    
+    stream.writeByte((char) mKernelLengthParameter->getIndex());
+    stream.writeByte((char) mModeParameter->getIndex());
+    stream.writeByte((char) currentProgram);
 }
 
 void ParametricEqAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    // ignore anything that isn't ours, or is too short to hold every version 1 field
+    if(data == nullptr || sizeInBytes < stateVersion1Size)
+        return;
+    
+    MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+    if(stream.readInt() != stateMagic || stream.readInt() < 1)
+        return;
+    
+    Snapshot snapshot;
+    snapshot.loGain = stream.readFloat();
+    snapshot.midGain = stream.readFloat();
+    snapshot.hiGain = stream.readFloat();
+    snapshot.lowCrossover = stream.readFloat();
+    snapshot.highCrossover = stream.readFloat();
+    
+    const int lengthIndex = (unsigned char) stream.readByte();
+    const int mode = (unsigned char) stream.readByte();
+    const int program = (unsigned char) stream.readByte();
+    
+    if(lengthIndex < mKernelLengthParameter->choices.size())
+        *mKernelLengthParameter = lengthIndex;
+    if(mode < mModeParameter->choices.size())
+        *mModeParameter = mode;
+    currentProgram = jmin(program, FactoryPresets::numPresets - 1);
+    
+    // Hosts usually restore before prepareToPlay, which gets these kernels from the
+    // shared cache anyway. Otherwise the designer has them ready in a slot.
+    precomputeKernels(restoredSlot, snapshot);
+    applySnapshot(snapshot);
+}
+
+//==============================================================================
+ParametricEqAudioProcessor::Snapshot ParametricEqAudioProcessor::getSnapshot() const
+{
+    Snapshot snapshot;
+    snapshot.loGain = mLoGainParameter->get();
+    snapshot.midGain = mMidGainParameter->get();
+    snapshot.hiGain = mHiGainParameter->get();
+    snapshot.lowCrossover = mLowCrossoverParameter->get();
+    snapshot.highCrossover = mHighCrossoverParameter->get();
+    return snapshot;
+}
+
+void ParametricEqAudioProcessor::applySnapshot(const Snapshot& snapshot)
+{
+    // the audio thread picks these up at its next chunk, the same as a host automating them
+    *mLoGainParameter = snapshot.loGain;
+    *mMidGainParameter = snapshot.midGain;
+    *mHiGainParameter = snapshot.hiGain;
+    *mLowCrossoverParameter = snapshot.lowCrossover;
+    *mHighCrossoverParameter = snapshot.highCrossover;
+}
+
+void ParametricEqAudioProcessor::precomputeKernels(int slot, const Snapshot& snapshot)
+{
+    // nothing to design for until the sample rate is known
+    if(preparedBlockSize == 0)
+        return;
+    
+    // parameters store values through their normalised range, so match what they will read back
+    KernelSettings settings = getRequestedSettings();
+    settings.lowCrossover = mLowCrossoverParameter->convertFrom0to1(mLowCrossoverParameter->convertTo0to1(snapshot.lowCrossover));
+    settings.highCrossover = mHighCrossoverParameter->convertFrom0to1(mHighCrossoverParameter->convertTo0to1(snapshot.highCrossover));
+    kernelDesigner.requestPrecomputed(slot, settings);
+}
+
+void ParametricEqAudioProcessor::toggleAB()
+{
+    const int current = showingB ? 1 : 0;
+    abSnapshots[current] = getSnapshot();
+    
+    // the first toggle starts both snapshots from the live settings
+    if(! abStored)
+    {
+        abSnapshots[1 - current] = abSnapshots[current];
+        abStored = true;
+    }
+    
+    precomputeKernels(abSlot + current, abSnapshots[current]);
+    precomputeKernels(abSlot + 1 - current, abSnapshots[1 - current]);
+    
+    showingB = ! showingB;
+    applySnapshot(abSnapshots[1 - current]);
 }
 
 //==============================================================================
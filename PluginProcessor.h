@@ -1,18 +1,33 @@
 // This is the header definition for the audio processing functions
-// and class members, including the filter coefficients for each of the
-// 3 EQ bands: low pass, band pass, and high pass
+// and class members for the 3 EQ bands: low pass, band pass, and high pass.
+// The band kernels themselves are designed at runtime by KernelDesigner.
 
 #pragma once
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "FIRKernels.h"
+#include "DelayLine.h"
+#include "FFTConvolver.h"
+#include "IIRCrossover.h"
+#include "ChannelWorkerPool.h"
+#include "KernelDesigner.h"
+#include "KernelCache.h"
+#include "FactoryPresets.h"
+#include "ClassicKernels.h"
+#include "SpectrumFeed.h"
+#include "BlockTelemetry.h"
 
 // Maximum number of coefficients allowed in FIR filter
-#define MAX_COEF 41
+#define MAX_KERNEL_LENGTH 4097
+
+// Maximum number of channels, enough for 7.1.4 or 3rd order ambisonics
+#define MAX_CHANNELS 16
 
 //==============================================================================
 /**
 */
-class ParametricEqAudioProcessor  : public AudioProcessor
+class ParametricEqAudioProcessor  : public AudioProcessor,
+                                    private Timer
 {
 public:
     //==============================================================================
@@ -28,6 +43,10 @@ public:
    #endif
 
     void processBlock (AudioBuffer<float>&, MidiBuffer&) override;
+    void processBlock (AudioBuffer<double>&, MidiBuffer&) override;
+    
+    // Double precision hosts get their own filter path, set up in prepareToPlay
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     AudioProcessorEditor* createEditor() override;
@@ -52,152 +71,390 @@ public:
     void getStateInformation (MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
-    float filter(float* buffer, double* coeffs, int P, int n, int chan);
+    // Hands band kernels of any length up to MAX_KERNEL_LENGTH to the audio thread,
+    // which picks direct form or FFT convolution for that length. They replace the
+    // designed kernels until the crossover or length parameters next change.
+    // Call this after prepareToPlay, which designs kernels for the new sample rate.
+    void setBandKernels(const float* lo, const float* mid, const float* hi, int length);
+    
+    // True when the current kernels are long enough to be run by FFT convolution
+    bool isUsingFFTConvolution() const { return useFFTConvolution; }
+    
+    // True in the low latency mode, where the IIR crossover runs instead of the FIR kernels
+    bool isUsingIIRFilter() const { return useIIRFilter; }
+    
+    // True when any of the Low, Mid and High output buses is on. Each one carries its
+    // band with the gain applied, in the main output's layout and at the same latency,
+    // so a multiband chain can take the split from here instead of crossing over again.
+    bool hasBandOutputs() const { return useBandOutputs; }
+    
+    // A/B comparison between two snapshots of the band gains and crossovers. Toggling
+    // stores the live settings in the current snapshot and brings back the other one,
+    // whose kernels the designer made when it was stored, so the switch is a plain crossfade.
+    void toggleAB();
+    bool isShowingB() const { return showingB; }
+    
+    // Kernel settings asked for by the current parameters and sample rate,
+    // also used by the editor to draw the response curve
+    KernelSettings getRequestedSettings() const;
+    
+    // Parameters by ID, for the command line tools that drive the processor without
+    // a host. An unknown ID, or one of the other type, asserts and returns nullptr.
+    AudioParameterFloat* getFloatParameter(const String& paramID) const;
+    AudioParameterChoice* getChoiceParameter(const String& paramID) const;
     
-    float filterIIR(float* buffer, double* coeffsA, double* coeffsB, int A, int B, int n, int chan);
+    // Input and output samples for the editor's spectrum display
+    SpectrumFeed& getSpectrumFeed() { return spectrumFeed; }
+    
+   #if EQ_TELEMETRY
+    // Timing of every processBlock call, for the editor and bug reports
+    BlockTelemetry& getTelemetry() { return telemetry; }
+   #endif
 
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParametricEqAudioProcessor)
     
+    // Reports a latency change made on the audio thread from the message thread. The audio
+    // thread only sets a flag, as posting a message to the message thread takes a lock.
+    void timerCallback() override;
+    
     // Parameters for user control of high, mid, and low gain
     AudioParameterFloat* mLoGainParameter;
     AudioParameterFloat* mMidGainParameter;
     AudioParameterFloat* mHiGainParameter;
     
-    // Necessary state information for filter function
-    double xStateL[MAX_COEF];
-    double xStateR[MAX_COEF];
+    // Parameters for the crossover frequencies and the kernel length
+    AudioParameterFloat* mLowCrossoverParameter;
+    AudioParameterFloat* mHighCrossoverParameter;
+    AudioParameterChoice* mKernelLengthParameter;
+    
+    // Parameter choosing between the linear phase FIR and low latency IIR modes
+    AudioParameterChoice* mModeParameter;
     
-    // P corresponds to low and band pass Coefficients
-    // P2 corresonds to high pass coefficients
-    const static int P = 41;
-    const static int P2 = 33;
+    // Audio thread: picks up a kernel set finished by the designer
+    void adoptNewKernels();
     
-    double lowPass[MAX_COEF] =
+    // Audio thread: switches to a precomputed kernel set made for these settings, if there is one
+    bool adoptPrecomputedKernels(const KernelSettings& settings);
+    
+    // Audio thread: makes kernels the active set, taking over a reference to it.
+    // The reference to the previous set goes back to the designer.
+    void switchKernels(const EQKernelSet* kernels);
+    
+    // The parameters a preset, an A/B snapshot or a saved state sets
+    struct Snapshot
     {
-        -0.0003919,
-        -0.0007032,
-        -0.001203
-        -0.001776,
-        -0.002304,
-        -0.002603,
-        -0.002426,
-        -0.001483,
-        0.0005265,
-        0.003875,
-        0.008755,
-        0.01524,
-        0.02323,
-        0.03247,
-        0.04251,
-        0.05276,
-        0.06252,
-        0.07107,
-        0.07774,
-        0.08198,
-        0.08344,
-        0.08198,
-        0.07774,
-        0.07107,
-        0.06252,
-        0.05276,
-        0.04251,
-        0.03247,
-        0.02323,
-        0.01524,
-        0.008755,
-        0.003875,
-        0.0005265,
-        -0.001483,
-        -0.002426,
-        -0.002603,
-        -0.002304,
-        -0.001776,
-        -0.001203,
-        -0.0007032,
-        -0.0003919
+        float loGain, midGain, hiGain;
+        float lowCrossover, highCrossover;
     };
+    Snapshot getSnapshot() const;
+    void applySnapshot(const Snapshot& snapshot);
+    
+    // Asks the designer thread for kernels for a snapshot at the current sample rate and
+    // length, which it hands to the audio thread in a precomputed slot
+    void precomputeKernels(int slot, const Snapshot& snapshot);
+    
+    // Sets up direct form or FFT convolution for the length of the active kernels.
+    // This switches without a crossfade, the filter state starts again from silence.
+    void loadKernelStructure();
+    
+    // Switches between the FIR and IIR modes when the mode parameter has changed.
+    // Like a new kernel length this changes the latency, so it switches without a crossfade.
+    void updateFilterMode();
+    
+    // Clears the IIR crossover and sets it straight to the current parameters
+    void resetIIRFilter();
+    
+    // Snapshots the parameters for the IIR crossover, ramping to new gains
+    void updateIIRFilter();
+    
+    // Latency of the FIR mode, the group delay of the linear phase kernels plus FFT partition
+    int getFIRLatencySamples() const;
+    
+    // Sets tailSamples for the current mode and kernels
+    void updateTailLength();
+    
+    // Fills combined kernel slot with g_lo*low + g_mid*mid + g_hi*high band kernel, in both precisions
+    void buildCombinedKernel(int slot, float loGain, float midGain, float hiGain);
+    
+    // Fills the combined and low rate kernel slot of one precision, returns whether it's a unit impulse
+    template <typename FloatType>
+    bool buildCombinedKernel(int slot, float loGain, float midGain, float hiGain);
+    
+    // Picks the FIR kernel for combined kernel slot in both precisions. Linear phase
+    // kernels fold their mirrored taps, anything else runs on the plain kernel.
+    void selectKernelProcess(int slot);
+    
+    template <typename FloatType>
+    void selectKernelProcess(int slot);
+    
+    // Moves the old kernels of one precision part of the way to the new ones, see updateCombinedKernel
+    template <typename FloatType>
+    void retargetFade(float progress);
+    
+    // Snapshots the parameters, and if the gains or kernels have changed rebuilds
+    // the combined kernel and starts a gain ramp from the previous kernel
+    void updateCombinedKernel();
+    
+    // Both processBlock overloads, the whole filter path is templated on the sample type
+    template <typename FloatType>
+    void process(AudioBuffer<FloatType>& buffer);
+    
+    // Filters all channels of up to preparedBlockSize samples of the block
+    template <typename FloatType>
+    void processChunk(AudioBuffer<FloatType>& buffer, int startSample, int numSamp);
+    
+    // Counts how long a channel's input has been silent, given its peak level in the chunk,
+    // and returns whether the channel is idle for this chunk. Clears the filter state of
+    // a channel that has just gone idle.
+    template <typename FloatType>
+    bool updateChannelIdle(int chan, double inputLevel, int numSamp);
+    
+    // Filters one channel of a chunk in place, and writes its bands if bands isn't nullptr
+    template <typename FloatType>
+    void processChannel(int chan, FloatType* y, FloatType* const* bands, int numSamp, int fadeSamples, int fadeOffset);
     
-    double bandPass[MAX_COEF] =
+    // Points bands at one channel of a chunk in each band output bus, nullptr for buses that
+    // are off. Returns bands, or nullptr when no band output is on.
+    template <typename FloatType>
+    FloatType** getBandOutputs(AudioBuffer<FloatType>& buffer, int chan, int startSample, FloatType** bands) const;
+    
+    // Runs the gain weighted band kernels over one channel's chunk, straight into the band
+    // output buses. x is the chunk's first sample in the delay line, the fade follows the
+    // combined kernel's.
+    template <typename FloatType>
+    void processBands(int chan, const FloatType* x, FloatType* const* bands, int numSamp, int fadeSamples, int fadeOffset);
+    
+    // Runs one channel of a chunk through the FFT convolver, and through the band
+    // convolvers into bands if it isn't nullptr
+    template <typename FloatType>
+    void processFFT(int chan, FloatType* y, FloatType* const* bands, int numSamp);
+    
+    // Adds the multirate low band of one channel's chunk to y. x is the chunk's first
+    // sample in the delay line, and the fade follows the combined kernel's.
+    template <typename FloatType>
+    void addLowBand(int chan, const FloatType* x, FloatType* y, int numSamp, int fadeSamples, int fadeOffset);
+    
+    // Filters one group of channels of a chunk in place with the IIR crossover
+    template <typename FloatType>
+    void filterIIR(AudioBuffer<FloatType>& buffer, int group, int numChans, int startSample, int numSamp);
+    
+    // Everything the channels share for one block, handed to the worker pool
+    template <typename FloatType>
+    struct ChannelJob
     {
-        -4.652e-07,
-        -5.335e-06,
-        -3.298e-05,
-        -0.0001441,
-        -0.0004942,
-        -0.001407,
-        -0.003432,
-        -0.007326,
-        -0.01387,
-        -0.02345,
-        -0.03554,
-        -0.04819,
-        -0.05791,
-        -0.06022,
-        -0.05095,
-        -0.02796,
-        0.007339,
-        0.04948,
-        0.08984,
-        0.119,
-        0.1296,
-        0.119,
-        0.08984,
-        0.04948,
-        0.007339,
-        -0.02796,
-        -0.05095,
-        -0.06022,
-        -0.05791,
-        -0.04819,
-        -0.03554,
-        -0.02345,
-        -0.01387,
-        -0.007326,
-        -0.003432,
-        -0.001407,
-        -0.0004942,
-        -0.0001441,
-        -3.298e-05,
-        -5.335e-06,
-        -4.652e-07
+        ParametricEqAudioProcessor* processor;
+        AudioBuffer<FloatType>* buffer;
+        int numChannels;
+        int startSample;
+        int numSamp;
+        int fadeSamples;
+        int fadeOffset;
     };
     
-    double hiPass[MAX_COEF] =
+    // Worker pool job, filters one group of channels
+    template <typename FloatType>
+    static void processChannelGroup(void* context, int group);
+    
+    // Number of channels of the main bus, set in prepareToPlay
+    int numChannels = 0;
+    
+    // With at least minChannelsForWorkers channels, groups of channelsPerGroup
+    // channels are spread across the worker pool. The groups match the SIMD
+    // lanes of the IIR crossover, so each group is one pass of it.
+    const static int minChannelsForWorkers = 8;
+    const static int channelsPerGroup = IIRCrossover<float>::channelsPerGroup;
+    ChannelWorkerPool workerPool;
+    
+    // The kernels, filter state and buffers of one sample type. Both sets always hold the
+    // current kernels and crossover settings, but only the one for the host's processing
+    // precision gets channel buffers in prepareToPlay.
+    template <typename FloatType>
+    struct FilterState
     {
-        0.00363,
-        0.001044,
-        -0.001626,
-        -0.005666,
-        -0.008914,
-        -0.00845,
-        -0.002127,
-        0.009719,
-        0.02319,
-        0.03131,
-        0.02627,
-        0.00259,
-        -0.03974,
-        -0.09402,
-        -0.1481,
-        -0.188,
-        0.7973,
-        -0.188,
-        -0.1481,
-        -0.09402,
-        -0.03974,
-        0.00259,
-        0.02627,
-        0.03131,
-        0.02319,
-        0.009719,
-        -0.002127,
-        -0.00845,
-        -0.008914,
-        -0.005666,
-        -0.001626,
-        0.001044,
-        0.00363
+        // FIR kernel picked for this CPU at construction time
+        FIRKernels::ProcessFunction<FloatType> firProcess;
+        
+        // FIR kernel for each combined kernel slot, the symmetric version
+        // when the slot's taps are symmetric, see selectKernelProcess
+        FIRKernels::ProcessFunction<FloatType> kernelProcess[2];
+        
+        // Per channel input history. Each block is written behind the last
+        // MAX_KERNEL_LENGTH-1 samples, so the FIR kernels always see one contiguous
+        // history+block window for any kernel and any block size.
+        DelayLine<FloatType> delayLine;
+        
+        // Output of the previous kernel while crossfading to a new one, per channel
+        AudioBuffer<FloatType> fadeBuffer;
+        
+        // The two combined kernels, see currentKernel
+        AudioBuffer<FloatType> combinedKernels;
+        
+        // Gain weighted band kernels for the band outputs, channel 3*slot + band, and the
+        // FIR kernel for each slot's bands. Only sized while a band output is on.
+        AudioBuffer<FloatType> bandKernels;
+        FIRKernels::ProcessFunction<FloatType> bandProcess[2];
+        
+        // Multirate low band, see useMultirate. The resampler and its polyphase
+        // interpolator are copied from the active kernels when they're loaded.
+        AudioBuffer<FloatType> lowRateKernels;
+        AudioBuffer<FloatType> lowRateInput;
+        AudioBuffer<FloatType> lowRateOutput;
+        AudioBuffer<FloatType> resampler;
+        AudioBuffer<FloatType> phases;
+        
+        // fadeRamp[i] = (i+1)/fadeLength, so the crossfade runs as vector operations
+        HeapBlock<FloatType> fadeRamp;
+        
+        // Filter of the low latency mode
+        IIRCrossover<FloatType> iirCrossover;
+        
+        // FFT convolution of long kernels, see useFFTConvolution, and a convolver
+        // per band for the band outputs that are on
+        FFTConvolver<FloatType> fftConvolver;
+        FFTConvolver<FloatType> bandConvolvers[3];
+        
+        // Sizes the kernel buffers and picks the FIR kernel
+        FilterState();
+        
+        // Sizes the channel buffers for prepareToPlay, or frees them for 0 channels
+        void prepare(int numChannels, int samplesPerBlock, int fadeLength, bool bandOutputs);
+        
+        // Clears the FIR filter state of every channel, or of one
+        void clear();
+        void clearChannel(int chan);
+        
+        // Copies the resampler and interpolator of a multirate low band
+        void loadResampler(const MultirateLowBand& multirate);
+        
+        // Sizes the FFT convolvers for prepareToPlay, the band ones only for the buses that are on
+        void prepareConvolvers(int numChannels, int partitionSize, const int* bandChannels);
+        
+        // Sets a combined kernel slot of the FFT convolvers from the set's spectra, if it has
+        // them in this precision. Each band output's convolver gets its own band.
+        void mixConvolverKernels(int slot, const EQKernelSet& kernels, const float* gains, const int* bandChannels);
+        
+        // Switches the FFT convolvers to a slot, with a crossfade or from silence
+        void switchConvolvers(int slot, bool crossfade);
+        
+        // True while the convolvers that make the output still crossfade. With all three band
+        // outputs on, the band convolvers switch together and stand in for the main one.
+        bool isSwitchingConvolvers(bool bandSum) const;
     };
+    
+    FilterState<float> floatState;
+    FilterState<double> doubleState;
+    
+    template <typename FloatType>
+    FilterState<FloatType>& getState();
+    
+    // Processing precision the host asked for before prepareToPlay. Kernels are
+    // designed with spectra in this precision for the FFT convolvers.
+    bool useDoublePrecision = false;
+    
+    // Kernels of at least this many taps are run by FFT convolution, shorter ones in direct form.
+    // The double precision FFT is slower than dsp::FFT, so direct form wins for longer there.
+    const static int fftKernelThreshold = 256;
+    const static int doubleFFTKernelThreshold = 1024;
+    int getFFTKernelThreshold() const { return useDoublePrecision ? doubleFFTKernelThreshold : fftKernelThreshold; }
+    bool useFFTConvolution = false;
+    int partitionSize = 0;
+    
+    // Band output buses, which follow the main output bus. The first channel of each in the
+    // process buffer, or -1 while the bus is off. Their multirate low band would only exist
+    // mixed into the mid band, so kernels are designed without it while any of them is on.
+    // In FFT mode each band has its own convolver. With all three on, the main output is
+    // their sum, so the split isn't filtered a second time through the combined kernel.
+    const static int firstBandBus = 1;
+    bool useBandOutputs = false;
+    bool useBandSum = false;
+    int bandChannels[3] = { -1, -1, -1 };
+    
+    // Sample rate and block size announced in prepareToPlay, block size is 0 until then
+    double currentSampleRate = 44100.0;
+    int preparedBlockSize = 0;
+    
+    // Latency for timerCallback to report to the host, and whether it has changed since
+    std::atomic<int> latencyToReport { 0 };
+    std::atomic<bool> latencyChanged { false };
+    
+    // Silence detection. Samples of silent input in a row per channel, and whether each
+    // channel is idle, which happens once the silence is longer than the filter's tail.
+    // The tail is the whole impulse response with latency, also reported to the host.
+    HeapBlock<int> silentSamples;
+    HeapBlock<bool> channelIdle;
+    std::atomic<int> tailSamples { 0 };
+    
+    // Designs kernels on a background thread, and the set the audio thread is using.
+    // Every set comes from the shared cache, and this instance holds a reference to the
+    // active one. The designer holds the precomputed ones.
+    KernelDesigner kernelDesigner;
+    const EQKernelSet* activeKernels = nullptr;
+    int kernelLength = 0;
+    
+    // Designer slots for the factory presets, the two A/B snapshots and a restored state,
+    // designed ahead of time so the audio thread can switch to them straight away
+    SharedResourcePointer<KernelCache> kernelCache;
+    const static int abSlot = FactoryPresets::numPresets;
+    const static int restoredSlot = abSlot + 2;
+    static_assert(restoredSlot < KernelDesigner::maxPrecomputed, "not enough precomputed slots");
+    
+    // Current program, and the A/B snapshots once the first toggle has stored them
+    int currentProgram = 0;
+    Snapshot abSnapshots[2];
+    bool abStored = false;
+    bool showingB = false;
+    
+    // Settings last asked of the designer
+    KernelSettings requestedSettings;
+    
+    // Low latency mode, and the crossovers and gains the IIR filter was last set to
+    bool useIIRFilter = false;
+    float iirLowCrossover = 0;
+    float iirHighCrossover = 0;
+    float iirLoGain = 1;
+    float iirMidGain = 1;
+    float iirHiGain = 1;
+    
+    // The EQ is linear, so the three bands are folded into one gain weighted kernel.
+    // Two kernels are kept so a gain change can crossfade from the old one to the new one.
+    // In FFT mode the matching spectra live in convolver slots 0 and 1.
+    int currentKernel = 0;
+    
+    // Gains and kernel set the current kernel was built with
+    float kernelLoGain;
+    float kernelMidGain;
+    float kernelHiGain;
+    const EQKernelSet* kernelSource = nullptr;
+    
+    // Taps of each combined kernel that can be non-zero, direct form skips the rest
+    int kernelFirstTap[2] = { 0, 0 };
+    int kernelNumTaps[2] = { 0, 0 };
+    
+    // Whether each combined kernel is a unit impulse at its centre, which direct form
+    // runs as a plain delay instead of convolving
+    bool kernelIsDelay[2] = { false, false };
+    
+    // Multirate low band of the active kernels, see MultirateLowBand. Each combined kernel
+    // has a low rate kernel scaled by g_lo - g_mid. lowRateInput holds the decimated input
+    // after its history, and lowRateOutput the output of both low rate kernels after theirs,
+    // two channels per input channel. sampleClock counts samples since the structure was
+    // loaded, so every channel decimates at the same instants.
+    bool useMultirate = false;
+    int64 sampleClock = 0;
+    
+    // Gain ramps crossfade between the two kernels. Both kernels are linear in
+    // the gains, so this is exactly a linear ramp of the band gains.
+    // fadeLength is fadeTimeSeconds at the current sample rate.
+    static constexpr double fadeTimeSeconds = 0.01;
+    int fadeLength = 512;
+    int fadeSamplesRemaining = 0;
+    
+    // Feeds the editor's spectrum display, skipped while no editor is open
+    SpectrumFeed spectrumFeed;
+    
+   #if EQ_TELEMETRY
+    BlockTelemetry telemetry;
+   #endif
 };
@@ -0,0 +1,404 @@
+// This file contains the offline batch renderer. It streams WAV, AIFF or
+// FLAC files through the same processor the plug-in uses, a block at a
+// time, so files of any length render in a fixed amount of memory.
+//
+// Files are rendered in parallel on a thread pool. Long files are also cut
+// into chunks for separate cores: each chunk starts a fresh processor a
+// little before its first sample and runs that pre-roll to build up the
+// filter state, then keeps only its own samples. The FIR filters only
+// remember the last kernel length of input, and the pre-roll starts and
+// ends on the same block, partition and decimation boundaries as a sequential render,
+// so every chunk comes out bit-identical to rendering the file in one go.
+// The IIR mode remembers its input forever, so its files are never split.
+//
+// The processor's latency is compensated, the output lines up with the input
+// and has the same length.
+//
+//     Renderer --output-dir <dir> [options] <input files...>
+//
+//     --low-gain, --mid-gain, --high-gain <0..1.5>
+//     --low-crossover, --high-crossover <Hz>
+//     --length <taps>          kernel length, one of the plug-in's choices
+//     --mode <linear|iir>      linear phase FIR or low latency IIR
+//     --format <wav|aiff|flac> output format, by default the input's
+//     --block <samples>        processing block size, default 4096
+//     --chunk-seconds <s>      length of parallel chunks, 0 to never split files
+//     --threads <n>            worker threads, default one per CPU
+
+#include "../PluginProcessor.h"
+#include <iostream>
+#include <map>
+
+namespace
+{
+    struct RenderSettings
+    {
+        float loGain = 1.0f, midGain = 1.0f, hiGain = 1.0f;
+        float lowCrossover = 500.0f, highCrossover = 4000.0f;
+        int kernelLength = 129;
+        bool lowLatency = false;
+        String format;
+        int blockSize = 4096;
+        double chunkSeconds = 30.0;
+        int numThreads = 0;
+    };
+
+    bool setKernelLength (ParametricEqAudioProcessor& processor, int kernelLength)
+    {
+        if (auto* choice = processor.getChoiceParameter ("kernellength"))
+        {
+            for (int i = 0; i < choice->choices.size(); i++)
+            {
+                if (choice->choices[i].getIntValue() == kernelLength)
+                {
+                    *choice = i;
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // A processor set up for one file. Every chunk of a file gets an identical one.
+    std::unique_ptr<ParametricEqAudioProcessor> createProcessor (const RenderSettings& settings,
+                                                                 int numChannels, double sampleRate)
+    {
+        std::unique_ptr<ParametricEqAudioProcessor> processor (new ParametricEqAudioProcessor());
+
+        *processor->getFloatParameter ("lowgain") = settings.loGain;
+        *processor->getFloatParameter ("midgain") = settings.midGain;
+        *processor->getFloatParameter ("higain") = settings.hiGain;
+        *processor->getFloatParameter ("lowfreq") = settings.lowCrossover;
+        *processor->getFloatParameter ("highfreq") = settings.highCrossover;
+        setKernelLength (*processor, settings.kernelLength);
+
+        *processor->getChoiceParameter ("mode") = settings.lowLatency ? 1 : 0;
+
+        // kernels for the file's sample rate are designed right here
+        processor->setNonRealtime (true);
+        processor->setPlayConfigDetails (numChannels, numChannels, sampleRate, settings.blockSize);
+        processor->prepareToPlay (sampleRate, settings.blockSize);
+        return processor;
+    }
+
+    //==============================================================================
+    // One file being rendered. The stream is the input followed by latency samples
+    // of silence, and the output is the processed stream minus its first latency samples.
+    struct FileRender
+    {
+        File input, output;
+        RenderSettings settings;
+        AudioFormatManager* formats = nullptr;
+
+        int numChannels = 0;
+        double sampleRate = 0;
+        int64 length = 0;
+        int latency = 0;
+
+        int64 streamLength = 0;
+        int64 chunkLength = 0;
+        int64 preRoll = 0;
+        int numChunks = 1;
+
+        std::unique_ptr<AudioFormatWriter> writer;
+
+        // chunks finished ahead of the one the writer is waiting for
+        CriticalSection writeLock;
+        std::map<int, std::unique_ptr<AudioBuffer<float>>> finishedChunks;
+        int nextChunkToWrite = 0;
+        std::atomic<bool> failed { false };
+
+        // Writes processed stream samples starting at streamPosition, minus the latency
+        void write (const AudioBuffer<float>& buffer, int64 streamPosition)
+        {
+            const int64 first = jmax (streamPosition, (int64) latency);
+            const int64 last = jmin (streamPosition + buffer.getNumSamples(), latency + length);
+
+            if (last > first && ! writer->writeFromAudioSampleBuffer (buffer, (int) (first - streamPosition), (int) (last - first)))
+                failed = true;
+        }
+
+        // Takes a finished chunk and writes every chunk that is now next in line
+        void chunkFinished (int chunk, AudioBuffer<float>* chunkOutput)
+        {
+            const ScopedLock sl (writeLock);
+            finishedChunks[chunk].reset (chunkOutput);
+
+            for (auto next = finishedChunks.find (nextChunkToWrite); next != finishedChunks.end();
+                 next = finishedChunks.find (nextChunkToWrite))
+            {
+                write (*next->second, nextChunkToWrite * chunkLength);
+                finishedChunks.erase (next);
+                nextChunkToWrite++;
+            }
+
+            // the last chunk is written, so the file can be closed
+            if (nextChunkToWrite == numChunks)
+                writer.reset();
+        }
+    };
+
+    // Renders one chunk of a file, or the whole file when it isn't split
+    void renderChunk (FileRender& file, int chunk)
+    {
+        const int blockSize = file.settings.blockSize;
+        const int64 start = chunk * file.chunkLength;
+        const int64 end = jmin (file.streamLength, start + file.chunkLength);
+        const int64 preRollStart = jmax ((int64) 0, start - file.preRoll);
+
+        std::unique_ptr<AudioFormatReader> reader (file.formats->createReaderFor (file.input));
+        if (reader == nullptr)
+        {
+            file.failed = true;
+            return;
+        }
+
+        auto processor = createProcessor (file.settings, file.numChannels, file.sampleRate);
+
+        // a split file holds each chunk back until the chunks before it are written
+        std::unique_ptr<AudioBuffer<float>> chunkOutput;
+        if (file.numChunks > 1)
+            chunkOutput.reset (new AudioBuffer<float> (file.numChannels, (int) (end - start)));
+
+        AudioBuffer<float> block (file.numChannels, blockSize);
+        MidiBuffer midi;
+
+        for (int64 position = preRollStart; position < end; position += blockSize)
+        {
+            // the reader fills anything past the end of the file with silence
+            const int numSamples = (int) jmin ((int64) blockSize, end - position);
+            AudioBuffer<float> blockView (block.getArrayOfWritePointers(), file.numChannels, numSamples);
+            reader->read (&blockView, 0, numSamples, position, true, true);
+
+            processor->processBlock (blockView, midi);
+
+            // the pre-roll only builds up the filter state
+            if (position < start)
+                continue;
+
+            if (chunkOutput != nullptr)
+            {
+                for (int chan = 0; chan < file.numChannels; chan++)
+                    chunkOutput->copyFrom (chan, (int) (position - start), blockView, chan, 0, numSamples);
+            }
+            else
+            {
+                file.write (blockView, position);
+            }
+        }
+
+        if (chunkOutput != nullptr)
+            file.chunkFinished (chunk, chunkOutput.release());
+        else
+            file.writer.reset();
+    }
+
+    class ChunkJob : public ThreadPoolJob
+    {
+    public:
+        ChunkJob (FileRender& f, int c)
+            : ThreadPoolJob (f.input.getFileName() + " chunk " + String (c)), file (f), chunk (c) {}
+
+        JobStatus runJob() override
+        {
+            renderChunk (file, chunk);
+            return jobHasFinished;
+        }
+
+    private:
+        FileRender& file;
+        const int chunk;
+    };
+
+    //==============================================================================
+    // Opens the input and creates the output writer, returns an error message on failure
+    String prepareFile (FileRender& file, const File& outputDirectory)
+    {
+        std::unique_ptr<AudioFormatReader> reader (file.formats->createReaderFor (file.input));
+        if (reader == nullptr)
+            return "can't read " + file.input.getFullPathName();
+
+        file.numChannels = (int) reader->numChannels;
+        file.sampleRate = reader->sampleRate;
+        file.length = reader->lengthInSamples;
+
+        if (file.numChannels > MAX_CHANNELS)
+            return file.input.getFileName() + " has more than " + String (MAX_CHANNELS) + " channels";
+
+        const String extension = file.settings.format.isNotEmpty() ? "." + file.settings.format
+                                                                   : file.input.getFileExtension();
+        file.output = outputDirectory.getChildFile (file.input.getFileNameWithoutExtension() + extension);
+
+        if (file.output == file.input)
+            return "won't overwrite " + file.input.getFullPathName();
+
+        AudioFormat* format = file.formats->findFormatForFileExtension (extension);
+        if (format == nullptr)
+            return "no writer for " + extension + " files";
+
+        // keep the input's bit depth, or the deepest the output format can do
+        Array<int> bitDepths = format->getPossibleBitDepths();
+        int bitsPerSample = (int) reader->bitsPerSample;
+        if (! bitDepths.contains (bitsPerSample))
+            bitsPerSample = bitDepths.getLast();
+
+        file.output.deleteFile();
+        std::unique_ptr<FileOutputStream> stream (file.output.createOutputStream());
+        if (stream == nullptr)
+            return "can't write " + file.output.getFullPathName();
+
+        file.writer.reset (format->createWriterFor (stream.get(), file.sampleRate, (unsigned int) file.numChannels,
+                                                    bitsPerSample, reader->metadataValues, 0));
+        if (file.writer == nullptr)
+            return "can't write " + file.output.getFullPathName();
+
+        // the writer owns the stream now
+        stream.release();
+
+        // the latency depends on the kernels designed for this sample rate
+        auto processor = createProcessor (file.settings, file.numChannels, file.sampleRate);
+        file.latency = processor->getLatencySamples();
+        file.streamLength = file.length + file.latency;
+
+        // Chunks start on block boundaries, which are FFT partition boundaries too, and
+        // the pre-roll covers the kernel plus the partitions the FFT engine holds on to.
+        // The IIR filter can't be primed exactly, so it runs each file in one piece.
+        const int blockSize = file.settings.blockSize;
+        file.preRoll = ((int64) file.settings.kernelLength + 3 * blockSize) / blockSize * blockSize;
+
+        const int64 chunkBlocks = roundToInt (file.settings.chunkSeconds * file.sampleRate / blockSize);
+        if (processor->isUsingIIRFilter() || chunkBlocks <= 0)
+        {
+            file.chunkLength = file.streamLength;
+            file.numChunks = 1;
+        }
+        else
+        {
+            file.chunkLength = jmax ((int64) 1, chunkBlocks) * blockSize;
+            file.numChunks = (int) ((file.streamLength + file.chunkLength - 1) / file.chunkLength);
+        }
+
+        file.numChunks = jmax (1, file.numChunks);
+        file.chunkLength = jmax ((int64) 1, file.chunkLength);
+        return {};
+    }
+
+    String getOption (const StringArray& args, const String& name, const String& defaultValue)
+    {
+        const int index = args.indexOf (name);
+        return index >= 0 && index + 1 < args.size() ? args[index + 1] : defaultValue;
+    }
+
+    // Everything after the options that isn't an option value is an input file
+    StringArray getInputFiles (const StringArray& args)
+    {
+        StringArray files;
+
+        for (int i = 0; i < args.size(); i++)
+        {
+            if (args[i].startsWith ("--"))
+                i++;
+            else
+                files.add (args[i]);
+        }
+
+        return files;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    StringArray args;
+    for (int i = 1; i < argc; i++)
+        args.add (argv[i]);
+
+    const String outputPath = getOption (args, "--output-dir", {});
+    const StringArray inputs = getInputFiles (args);
+
+    if (outputPath.isEmpty() || inputs.isEmpty())
+    {
+        std::cerr << "usage: Renderer --output-dir <dir> [options] <input files...>" << std::endl;
+        return 1;
+    }
+
+    RenderSettings settings;
+    settings.loGain = getOption (args, "--low-gain", "1").getFloatValue();
+    settings.midGain = getOption (args, "--mid-gain", "1").getFloatValue();
+    settings.hiGain = getOption (args, "--high-gain", "1").getFloatValue();
+    settings.lowCrossover = getOption (args, "--low-crossover", "500").getFloatValue();
+    settings.highCrossover = getOption (args, "--high-crossover", "4000").getFloatValue();
+    settings.kernelLength = getOption (args, "--length", "129").getIntValue();
+    settings.lowLatency = getOption (args, "--mode", "linear") == "iir";
+    settings.format = getOption (args, "--format", {});
+    settings.chunkSeconds = getOption (args, "--chunk-seconds", "30").getDoubleValue();
+    settings.numThreads = getOption (args, "--threads", String (SystemStats::getNumCpus())).getIntValue();
+
+    // power of two blocks are whole FFT partitions, which chunks rely on to match a sequential render
+    settings.blockSize = jlimit (64, 65536, nextPowerOfTwo (getOption (args, "--block", "4096").getIntValue()));
+
+    {
+        ParametricEqAudioProcessor processor;
+        if (! setKernelLength (processor, settings.kernelLength))
+        {
+            std::cerr << "unsupported kernel length " << settings.kernelLength << std::endl;
+            return 1;
+        }
+    }
+
+    const File outputDirectory = File::getCurrentWorkingDirectory().getChildFile (outputPath);
+    if (! outputDirectory.createDirectory())
+    {
+        std::cerr << "can't create " << outputDirectory.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    OwnedArray<FileRender> files;
+    ThreadPool pool (jmax (1, settings.numThreads));
+    bool anyFailed = false;
+
+    // chunks are queued in file order, so they finish roughly in the order they're written
+    for (const String& input : inputs)
+    {
+        FileRender* file = files.add (new FileRender());
+        file->input = File::getCurrentWorkingDirectory().getChildFile (input);
+        file->settings = settings;
+        file->formats = &formatManager;
+
+        const String error = prepareFile (*file, outputDirectory);
+        if (error.isNotEmpty())
+        {
+            std::cerr << error << std::endl;
+            anyFailed = true;
+            files.removeLast();
+            continue;
+        }
+
+        for (int chunk = 0; chunk < file->numChunks; chunk++)
+            pool.addJob (new ChunkJob (*file, chunk), true);
+    }
+
+    while (pool.getNumJobs() > 0)
+        Thread::sleep (50);
+
+    for (auto* file : files)
+    {
+        if (file->failed)
+        {
+            std::cerr << "failed to render " << file->input.getFullPathName() << std::endl;
+            anyFailed = true;
+        }
+        else
+        {
+            std::cout << file->output.getFullPathName() << std::endl;
+        }
+    }
+
+    return anyFailed ? 1 : 0;
+}
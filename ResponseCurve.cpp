@@ -0,0 +1,227 @@
+// This file contains the response curve. The bands of a kernel set always sum
+// to a pure delay and share the same linear phase, so the response is just the
+// gain weighted sum of the band magnitudes, without any phase to track.
+
+#include "ResponseCurve.h"
+
+namespace
+{
+    // Smallest zero-padded FFT, fine enough to resolve the lowest crossover
+    const int minFFTOrder = 13;
+
+    // Adds the magnitude of a kernel running at sampleRate at the frequency of every column,
+    // interpolated between bins. Columns above the kernel's Nyquist are left alone.
+    void addMagnitudes (float* magnitudes, const float* kernel, int length, double sampleRate,
+                        dsp::FFT& fft, float* fftData, double minFrequency, double maxFrequency, int width)
+    {
+        const int fftSize = fft.getSize();
+        zeromem (fftData, sizeof (float) * (size_t) (2 * fftSize));
+        FloatVectorOperations::copy (fftData, kernel, length);
+        fft.performFrequencyOnlyForwardTransform (fftData);
+
+        // columns are spaced logarithmically, like the spectrum analyser's
+        for (int x = 0; x < width; x++)
+        {
+            const double frequency = minFrequency * std::pow (maxFrequency / minFrequency, x / (double) width);
+            const double bin = frequency * fftSize / sampleRate;
+            const int lower = (int) bin;
+
+            if (lower < fftSize / 2)
+                magnitudes[x] += (float) jmap (bin - lower, (double) fftData[lower], (double) fftData[lower + 1]);
+        }
+    }
+}
+
+//==============================================================================
+ResponseCurve::ResponseCurve()
+    : Thread ("EQ response curve")
+{
+    setInterceptsMouseClicks (false, false);
+    startThread (2);
+}
+
+ResponseCurve::~ResponseCurve()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (4000);
+    cancelPendingUpdate();
+}
+
+void ResponseCurve::update (const KernelSettings& settings, float lo, float mid, float hi)
+{
+    {
+        const ScopedLock sl (lock);
+
+        if (settings == requestedSettings && lo == requestedGains[0] && mid == requestedGains[1]
+             && hi == requestedGains[2] && requestedWidth == getWidth() && requestedHeight == getHeight())
+            return;
+
+        requestedSettings = settings;
+        requestedGains[0] = lo;
+        requestedGains[1] = mid;
+        requestedGains[2] = hi;
+        requestedWidth = getWidth();
+        requestedHeight = getHeight();
+        requested = true;
+    }
+
+    notify();
+}
+
+void ResponseCurve::resized()
+{
+    KernelSettings settings;
+    float gains[3];
+
+    {
+        const ScopedLock sl (lock);
+        settings = requestedSettings;
+        memcpy (gains, requestedGains, sizeof (gains));
+    }
+
+    update (settings, gains[0], gains[1], gains[2]);
+}
+
+void ResponseCurve::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (-1);
+
+        KernelSettings settings;
+        float gains[3];
+        int width, height;
+
+        {
+            const ScopedLock sl (lock);
+            if (! requested)
+                continue;
+
+            // a burst of slider moves only gets drawn once, for the latest gains
+            settings = requestedSettings;
+            memcpy (gains, requestedGains, sizeof (gains));
+            width = requestedWidth;
+            height = requestedHeight;
+            requested = false;
+        }
+
+        if (width <= 0 || height <= 0)
+            continue;
+
+        if (settings != calculatedSettings || bandResponses.getNumSamples() != width)
+            calculateBandResponses (settings, width);
+
+        Path path;
+        for (int x = 0; x < width; x++)
+        {
+            float gain = 0.0f;
+            for (int band = 0; band < 3; band++)
+                gain += gains[band] * bandResponses.getSample (band, x);
+
+            const float decibels = Decibels::gainToDecibels (gain, minDecibels);
+            const float y = jmap (decibels, minDecibels, maxDecibels, (float) height, 0.0f);
+
+            if (x == 0)
+                path.startNewSubPath (0.0f, y);
+            else
+                path.lineTo ((float) x, y);
+        }
+
+        {
+            const ScopedLock sl (lock);
+            finishedPath.swapWithPath (path);
+        }
+
+        triggerAsyncUpdate();
+    }
+}
+
+void ResponseCurve::calculateBandResponses (const KernelSettings& settings, int width)
+{
+    // the processor normally holds this set already, so it only gets designed here
+    // if the curve has got ahead of the audio thread
+    const EQKernelSet* kernels = kernelCache->acquire (settings);
+
+    const int length = kernels->bands.getNumSamples();
+    int order = minFFTOrder;
+    while ((1 << order) < 4 * length)
+        order++;
+
+    dsp::FFT fft (order);
+    HeapBlock<float> fftData ((size_t) (2 * fft.getSize()));
+
+    const double maxFrequency = 0.5 * settings.sampleRate;
+
+    bandResponses.setSize (3, width);
+    bandResponses.clear();
+
+    for (int band = 0; band < 3; band++)
+        addMagnitudes (bandResponses.getWritePointer (band), kernels->bands.getReadPointer (band), length,
+                       settings.sampleRate, fft, fftData, minFrequency, maxFrequency, width);
+
+    // the multirate low band runs through the resampler lowpass on the way down and back up,
+    // and the mid band kernel passes the low band as well, so it comes off the mid response
+    const MultirateLowBand& multirate = kernels->multirate;
+    if (multirate.decimation > 0)
+    {
+        HeapBlock<float> resampler ((size_t) width, true);
+        HeapBlock<float> lowpass ((size_t) width, true);
+
+        addMagnitudes (resampler, multirate.resampler.getReadPointer (0), multirate.resampler.getNumSamples(),
+                       settings.sampleRate, fft, fftData, minFrequency, maxFrequency, width);
+
+        // the low rate kernel passes nothing above its own Nyquist
+        addMagnitudes (lowpass, multirate.lowpass.getReadPointer (0), multirate.lowpass.getNumSamples(),
+                       settings.sampleRate / multirate.decimation, fft, fftData, minFrequency, maxFrequency, width);
+
+        float* lo = bandResponses.getWritePointer (0);
+        float* mid = bandResponses.getWritePointer (1);
+
+        for (int x = 0; x < width; x++)
+        {
+            const float lowBand = resampler[x] * resampler[x] * lowpass[x];
+            lo[x] += lowBand;
+            mid[x] -= lowBand;
+        }
+    }
+
+    kernelCache->release (kernels);
+    calculatedSettings = settings;
+}
+
+void ResponseCurve::handleAsyncUpdate()
+{
+    Path path;
+
+    {
+        const ScopedLock sl (lock);
+        path = finishedPath;
+    }
+
+    if (image.getWidth() != getWidth() || image.getHeight() != getHeight())
+    {
+        image = Image (Image::ARGB, jmax (1, getWidth()), jmax (1, getHeight()), true);
+        curveBounds = getLocalBounds();
+    }
+    else
+    {
+        image.clear (curveBounds);
+    }
+
+    {
+        Graphics g (image);
+        g.setColour (Colours::orange);
+        g.strokePath (path, PathStrokeType (lineThickness));
+    }
+
+    // only the area the curve has left and the area it now covers need redrawing
+    const Rectangle<int> newBounds = path.getBounds().expanded (lineThickness).getSmallestIntegerContainer();
+    repaint (curveBounds.getUnion (newBounds));
+    curveBounds = newBounds;
+}
+
+void ResponseCurve::paint (Graphics& g)
+{
+    g.drawImageAt (image, 0, 0);
+}
@@ -0,0 +1,66 @@
+// This is the header for the frequency response curve drawn over the spectrum.
+// The band responses are worked out by zero-padded FFTs of the processor's
+// kernels, shared through the kernel cache, on a background thread and only
+// when the crossovers, kernel length or sample rate change. A gain change just
+// reweights them and rebuilds the path, which is then drawn once into an image,
+// so repaints only blit that image.
+// The curve shows the FIR response, which the IIR mode follows closely.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "KernelCache.h"
+
+class ResponseCurve  : public Component,
+                       private Thread,
+                       private AsyncUpdater
+{
+public:
+    ResponseCurve();
+    ~ResponseCurve();
+
+    // Asks for the curve of these settings and band gains. Returns straight away, the curve
+    // is redrawn once it's ready, and nothing happens if neither has changed. Message thread.
+    void update (const KernelSettings& settings, float lo, float mid, float hi);
+
+    void paint (Graphics&) override;
+    void resized() override;
+
+private:
+    // Designs and transforms the kernels when the settings change, then builds the path
+    void run() override;
+
+    // Draws the finished path into the image and repaints the area it has moved through
+    void handleAsyncUpdate() override;
+
+    // Magnitude of each band at every column, so a gain change needs no FFT
+    void calculateBandResponses (const KernelSettings& settings, int width);
+
+    // Range of the display, the frequency axis matches the spectrum analyser
+    static constexpr float minFrequency = 20.0f;
+    static constexpr float minDecibels = -24.0f;
+    static constexpr float maxDecibels = 6.0f;
+
+    static constexpr float lineThickness = 2.0f;
+
+    // What the curve was last asked for, written on the message thread
+    CriticalSection lock;
+    KernelSettings requestedSettings;
+    float requestedGains[3] = { 1.0f, 1.0f, 1.0f };
+    int requestedWidth = 0, requestedHeight = 0;
+    bool requested = false;
+
+    // Finished path, handed to the message thread under the lock
+    Path finishedPath;
+
+    // Background thread only: the settings and width the band responses are for
+    KernelSettings calculatedSettings;
+    AudioBuffer<float> bandResponses;
+    SharedResourcePointer<KernelCache> kernelCache;
+
+    // Message thread only: the curve drawn into an image, and the area it covers
+    Image image;
+    Rectangle<int> curveBounds;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ResponseCurve)
+};
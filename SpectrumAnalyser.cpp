@@ -0,0 +1,125 @@
+// This file contains the spectrum display. All buffers are allocated up
+// front, so each timer tick only copies samples, runs two FFTs and draws.
+
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+SpectrumAnalyser::SpectrumAnalyser (SpectrumFeed& f)
+    : feed (f),
+      fft (fftOrder),
+      window ((size_t) fftSize, dsp::WindowingFunction<float>::hann),
+      history (SpectrumFeed::numSignals, fftSize),
+      levels (SpectrumFeed::numSignals, numBins)
+{
+    history.clear();
+    pulled.malloc ((size_t) fftSize);
+    fftData.malloc ((size_t) (2 * fftSize));
+
+    for (int signal = 0; signal < SpectrumFeed::numSignals; signal++)
+        FloatVectorOperations::fill (levels.getWritePointer (signal), minDecibels, numBins);
+
+    setOpaque (true);
+    feed.setActive (true);
+    startTimerHz (30);
+}
+
+SpectrumAnalyser::~SpectrumAnalyser()
+{
+    stopTimer();
+    feed.setActive (false);
+}
+
+void SpectrumAnalyser::timerCallback()
+{
+    bool changed = false;
+
+    for (int signal = 0; signal < SpectrumFeed::numSignals; signal++)
+    {
+        float* samples = history.getWritePointer (signal);
+        bool arrived = false;
+
+        // slide the history along by whatever has arrived since the last tick
+        for (;;)
+        {
+            const int num = feed.pull ((SpectrumFeed::Signal) signal, pulled, fftSize);
+            if (num == 0)
+                break;
+
+            memmove (samples, samples + num, (size_t) (fftSize - num) * sizeof (float));
+            FloatVectorOperations::copy (samples + fftSize - num, pulled.getData(), num);
+            arrived = true;
+        }
+
+        if (! arrived)
+            continue;
+
+        FloatVectorOperations::copy (fftData.getData(), samples, fftSize);
+        window.multiplyWithWindowingTable (fftData, (size_t) fftSize);
+        fft.performFrequencyOnlyForwardTransform (fftData);
+
+        // the window is normalised, so a full scale sine reads 0 dB
+        float* level = levels.getWritePointer (signal);
+        for (int bin = 0; bin < numBins; bin++)
+        {
+            const float decibels = Decibels::gainToDecibels (fftData[bin] * 2.0f / fftSize, minDecibels);
+            level[bin] = jmax (decibels, level[bin] - decayDecibels);
+        }
+
+        changed = true;
+    }
+
+    if (changed)
+        repaint();
+}
+
+float SpectrumAnalyser::getLevelAt (int signal, double frequency) const
+{
+    const int bin = jlimit (0, numBins - 1, roundToInt (frequency * fftSize / feed.getSampleRate()));
+    return levels.getSample (signal, bin);
+}
+
+void SpectrumAnalyser::paint (Graphics& g)
+{
+    g.fillAll (Colours::black);
+
+    const float width = (float) getWidth();
+    const float height = (float) getHeight();
+    const double maxFrequency = 0.5 * feed.getSampleRate();
+
+    // log frequency on x, dB on y
+    auto frequencyToX = [=] (double frequency)
+    {
+        return width * (float) (std::log (frequency / minFrequency) / std::log (maxFrequency / minFrequency));
+    };
+    auto decibelsToY = [=] (float decibels)
+    {
+        return jmap (decibels, minDecibels, maxDecibels, height, 0.0f);
+    };
+
+    g.setColour (Colours::darkgrey);
+    for (double frequency : { 100.0, 1000.0, 10000.0 })
+        g.drawVerticalLine (roundToInt (frequencyToX (frequency)), 0.0f, height);
+    for (float decibels = -80.0f; decibels < maxDecibels; decibels += 20.0f)
+        g.drawHorizontalLine (roundToInt (decibelsToY (decibels)), 0.0f, width);
+
+    // input in grey behind the output
+    const Colour colours[SpectrumFeed::numSignals] = { Colours::grey, Colours::lightblue };
+
+    for (int signal = 0; signal < SpectrumFeed::numSignals; signal++)
+    {
+        Path path;
+        for (int x = 0; x < getWidth(); x++)
+        {
+            const double frequency = minFrequency * std::pow (maxFrequency / minFrequency, x / (double) width);
+            const float y = decibelsToY (getLevelAt (signal, frequency));
+
+            if (x == 0)
+                path.startNewSubPath (0.0f, y);
+            else
+                path.lineTo ((float) x, y);
+        }
+
+        g.setColour (colours[signal]);
+        g.strokePath (path, PathStrokeType (1.5f));
+    }
+}
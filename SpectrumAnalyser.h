@@ -0,0 +1,56 @@
+// This is the header for the spectrum display in the editor.
+// It draws the spectrum of the signal going into the EQ and the signal
+// coming out of it, so the effect of each band can be seen. The FFT runs
+// on the message thread on a timer, never in the audio callback.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SpectrumFeed.h"
+
+class SpectrumAnalyser  : public Component,
+                          private Timer
+{
+public:
+    // Turns the feed on for as long as the analyser exists
+    SpectrumAnalyser (SpectrumFeed& feed);
+    ~SpectrumAnalyser();
+
+    void paint (Graphics&) override;
+
+private:
+    // Pulls whatever the audio thread has pushed, runs the FFTs and repaints
+    void timerCallback() override;
+
+    // Level in dB of the given signal at a frequency, from the nearest FFT bin
+    float getLevelAt (int signal, double frequency) const;
+
+    static const int fftOrder = 12;
+    static const int fftSize = 1 << fftOrder;
+    static const int numBins = fftSize / 2 + 1;
+
+    // Range of the display
+    static constexpr float minFrequency = 20.0f;
+    static constexpr float minDecibels = -90.0f;
+    static constexpr float maxDecibels = 6.0f;
+
+    // How far the levels fall per frame, so peaks don't flicker
+    static constexpr float decayDecibels = 1.5f;
+
+    SpectrumFeed& feed;
+
+    dsp::FFT fft;
+    dsp::WindowingFunction<float> window;
+
+    // Newest fftSize samples of each signal, oldest first
+    AudioBuffer<float> history;
+
+    // Samples pulled from the feed, then the FFT's in-place working buffer
+    HeapBlock<float> pulled;
+    HeapBlock<float> fftData;
+
+    // Smoothed level in dB of every bin of each signal
+    AudioBuffer<float> levels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumAnalyser)
+};
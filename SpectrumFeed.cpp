@@ -0,0 +1,101 @@
+// This file contains the spectrum analyser feed. The decimator averages
+// each group of samples, which is crude as anti-aliasing goes but costs
+// next to nothing, and the display only needs to be roughly right up to
+// the feed's Nyquist frequency.
+
+#include "SpectrumFeed.h"
+
+namespace
+{
+    // Samples mixed down at a time, so the mix lives on the stack
+    const int mixBlockSize = 256;
+}
+
+//==============================================================================
+SpectrumFeed::SpectrumFeed()
+{
+    for (int signal = 0; signal < numSignals; signal++)
+        streams[signal].samples.calloc ((size_t) capacity);
+}
+
+SpectrumFeed::~SpectrumFeed() {}
+
+void SpectrumFeed::prepare (double sampleRate)
+{
+    decimation = jmax (1, (int) (sampleRate / 48000.0));
+    feedSampleRate = sampleRate / decimation;
+
+    for (int signal = 0; signal < numSignals; signal++)
+    {
+        streams[signal].sum = 0;
+        streams[signal].count = 0;
+    }
+}
+
+void SpectrumFeed::setActive (bool shouldBeActive)
+{
+    active.store (shouldBeActive, std::memory_order_relaxed);
+}
+
+template <typename FloatType>
+void SpectrumFeed::push (Signal signal, const AudioBuffer<FloatType>& buffer, int startSample, int numSamples, int numChannels)
+{
+    if (numChannels <= 0)
+        return;
+
+    Stream& stream = streams[signal];
+    const float scale = 1.0f / (float) (numChannels * decimation);
+
+    // room for every output this block can make, anything past the free space is dropped
+    int start1, size1, start2, size2;
+    stream.fifo.prepareToWrite ((stream.count + numSamples) / decimation, start1, size1, start2, size2);
+    int written = 0;
+
+    FloatType mix[mixBlockSize];
+
+    for (int first = 0; first < numSamples; first += mixBlockSize)
+    {
+        const int num = jmin (mixBlockSize, numSamples - first);
+
+        FloatVectorOperations::copy (mix, buffer.getReadPointer (0, startSample + first), num);
+        for (int chan = 1; chan < numChannels; chan++)
+            FloatVectorOperations::add (mix, buffer.getReadPointer (chan, startSample + first), num);
+
+        for (int i = 0; i < num; i++)
+        {
+            stream.sum += (float) mix[i];
+
+            if (++stream.count < decimation)
+                continue;
+
+            if (written < size1 + size2)
+            {
+                const int index = written < size1 ? start1 + written : start2 + written - size1;
+                stream.samples[index] = stream.sum * scale;
+                written++;
+            }
+
+            stream.sum = 0;
+            stream.count = 0;
+        }
+    }
+
+    stream.fifo.finishedWrite (written);
+}
+
+template void SpectrumFeed::push (Signal, const AudioBuffer<float>&, int, int, int);
+template void SpectrumFeed::push (Signal, const AudioBuffer<double>&, int, int, int);
+
+int SpectrumFeed::pull (Signal signal, float* dest, int maxSamples)
+{
+    Stream& stream = streams[signal];
+
+    int start1, size1, start2, size2;
+    stream.fifo.prepareToRead (maxSamples, start1, size1, start2, size2);
+
+    FloatVectorOperations::copy (dest, stream.samples + start1, size1);
+    FloatVectorOperations::copy (dest + size1, stream.samples + start2, size2);
+
+    stream.fifo.finishedRead (size1 + size2);
+    return size1 + size2;
+}
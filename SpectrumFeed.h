@@ -0,0 +1,60 @@
+// This is the header for the spectrum analyser feed.
+// The audio thread pushes a mono mix of the signal before and after the EQ
+// into two single producer, single consumer FIFOs, and the editor pulls it
+// out on its timer. Nothing locks or allocates on the audio thread, and
+// while no editor is open it only reads one atomic flag per chunk.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class SpectrumFeed
+{
+public:
+    SpectrumFeed();
+    ~SpectrumFeed();
+
+    enum Signal { input, output, numSignals };
+
+    // Samples each FIFO holds, about 0.7 seconds of the feed
+    static const int capacity = 32768;
+
+    // Picks a decimation that keeps the feed close to 48 kHz. Call it before playback starts.
+    void prepare (double sampleRate);
+
+    // The editor turns the feed on while it's open
+    void setActive (bool shouldBeActive);
+    bool isActive() const { return active.load (std::memory_order_relaxed); }
+
+    // Sample rate of the samples coming out of pull()
+    double getSampleRate() const { return feedSampleRate.load(); }
+
+    // Audio thread: mixes numChannels of the buffer down to mono, decimates and pushes it.
+    // Whatever doesn't fit is dropped, the display just misses those samples.
+    // Double buffers are mixed in double and only the decimated samples are stored as float.
+    template <typename FloatType>
+    void push (Signal signal, const AudioBuffer<FloatType>& buffer, int startSample, int numSamples, int numChannels);
+
+    // Editor: moves up to maxSamples of the oldest samples into dest and returns how many it moved
+    int pull (Signal signal, float* dest, int maxSamples);
+
+private:
+    // One FIFO, and the decimator's running sum of the samples since its last output
+    struct Stream
+    {
+        Stream() : fifo (capacity) {}
+
+        AbstractFifo fifo;
+        HeapBlock<float> samples;
+        float sum = 0;
+        int count = 0;
+    };
+
+    Stream streams[numSignals];
+    int decimation = 1;
+
+    std::atomic<bool> active { false };
+    std::atomic<double> feedSampleRate { 44100.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumFeed)
+};
@@ -0,0 +1,50 @@
+// This file contains the telemetry line in the editor. It only reads the
+// telemetry's atomics a few times a second, the audio thread never waits on it.
+
+#include "TelemetryDisplay.h"
+
+//==============================================================================
+TelemetryDisplay::TelemetryDisplay (BlockTelemetry& t)
+    : telemetry (t),
+      copyButton ("Copy JSON"),
+      resetButton ("Reset")
+{
+    copyButton.onClick = [this] { SystemClipboard::copyTextToClipboard (telemetry.toJSON()); };
+    resetButton.onClick = [this] { telemetry.reset(); };
+
+    addAndMakeVisible (copyButton);
+    addAndMakeVisible (resetButton);
+
+    startTimerHz (4);
+}
+
+TelemetryDisplay::~TelemetryDisplay()
+{
+    stopTimer();
+}
+
+void TelemetryDisplay::timerCallback()
+{
+    repaint();
+}
+
+void TelemetryDisplay::paint (Graphics& g)
+{
+    auto percent = [] (double load) { return String (100.0 * load, 1) + "%"; };
+
+    const String text = "DSP load p50 " + percent (telemetry.getLoadPercentile (0.5))
+                      + "  p99 " + percent (telemetry.getLoadPercentile (0.99))
+                      + "  max " + percent (telemetry.getMaxLoad())
+                      + "   over " + percent (telemetry.getDeadlineFraction()) + ": "
+                      + String (telemetry.getNumDeadlineMisses()) + " of " + String (telemetry.getNumBlocks()) + " blocks";
+
+    g.setColour (Colours::white);
+    g.setFont (13.0f);
+    g.drawFittedText (text, 0, 0, getWidth() - 170, getHeight(), Justification::centredLeft, 1);
+}
+
+void TelemetryDisplay::resized()
+{
+    copyButton.setBounds (getWidth() - 165, 0, 90, getHeight());
+    resetButton.setBounds (getWidth() - 70, 0, 70, getHeight());
+}
@@ -0,0 +1,29 @@
+// This is the header for the telemetry line in the editor.
+// It shows the DSP load and deadline misses of processBlock, and has
+// buttons to copy the full report as JSON or to start counting again.
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BlockTelemetry.h"
+
+class TelemetryDisplay  : public Component,
+                          private Timer
+{
+public:
+    TelemetryDisplay (BlockTelemetry& telemetry);
+    ~TelemetryDisplay();
+
+    void paint (Graphics&) override;
+    void resized() override;
+
+private:
+    void timerCallback() override;
+
+    BlockTelemetry& telemetry;
+
+    TextButton copyButton;
+    TextButton resetButton;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TelemetryDisplay)
+};